@@ -0,0 +1,1041 @@
+//
+// module/minclude 热路径基准：Processor投递/读取吞吐、入队到处理的延迟、多生产者环形队列是否丢任务、
+// 各队列模式每个任务的堆分配次数、fan_out开销、丢弃任务是否混入跟踪记录、协程单元的处理与排空、自动缩容、
+// 采样分析器能否产出折叠栈、Semphore与Event的唤醒延迟、StopWatch单次读数开销；每个结果输出一行JSON，便于比较版本间的回退
+//
+// 用法：mbench [threads=1,2,4] [batch=1,16] [tasks=200000] [sinks=1,2,4,8] [iters=20000] [only=push_pop]
+//       [modes=list,ring,steal,priority]
+// 请用Release构建运行
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <functional>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <new>
+
+#include "mprocessor.hpp"
+#include "msharded.hpp"
+#include "mcoroutine.hpp"
+#include "mprofiler.hpp"
+#include "StopWatch.h"
+
+using namespace m_module_space;
+
+/// 全局operator new计数，alloc基准据此统计每个任务的堆分配次数
+static std::atomic<int64_t> s_allocations(0);
+
+void *operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+/// 基准参数
+struct BenchOptions
+{
+    std::vector<int> m_threads{1, 2, 4, 8, 16, 32, 64};
+    std::vector<int> m_batches{1, 16, 64};
+    std::vector<int> m_sinks{1, 2, 4, 8};
+    std::vector<std::string> m_modes{"list", "ring", "steal", "priority"};
+    int m_tasks = 200000;
+    int m_iters = 20000;
+    std::string m_only;
+};
+
+/// 延迟样本，每个线程一份，结束后合并计算分位数
+class LatencySamples
+{
+public:
+    explicit LatencySamples(const size_t limit = 200000) : m_limit(limit)
+    {
+        m_samples.reserve(limit);
+    }
+
+private:
+    size_t m_limit;
+    std::vector<int64_t> m_samples;
+
+public:
+    inline void add(const int64_t ns)
+    {
+        if (m_samples.size() < m_limit)
+        {
+            m_samples.push_back(ns);
+        }
+    }
+
+    void merge(const LatencySamples &other)
+    {
+        m_samples.insert(m_samples.end(), other.m_samples.begin(), other.m_samples.end());
+    }
+
+    /// 输出"latency_ns":{...}
+    std::string to_json()
+    {
+        std::sort(m_samples.begin(), m_samples.end());
+
+        auto percentile = [&](const double ratio) -> int64_t {
+            if (m_samples.empty())
+            {
+                return 0;
+            }
+
+            size_t index = static_cast<size_t>(ratio * static_cast<double>(m_samples.size() - 1));
+            return m_samples[index];
+        };
+
+        std::ostringstream out;
+        out << "\"latency_ns\":{\"samples\":" << m_samples.size() << ",\"p50\":" << percentile(0.50)
+            << ",\"p90\":" << percentile(0.90) << ",\"p99\":" << percentile(0.99) << ",\"p999\":"
+            << percentile(0.999) << ",\"max\":" << (m_samples.empty() ? 0 : m_samples.back()) << "}";
+        return out.str();
+    }
+};
+
+struct BenchTask
+{
+    int64_t m_push_ns = 0;
+};
+
+/// 只统计数量与延迟的消费单元
+class CountingProcessor : public Processor<BenchTask>
+{
+public:
+    CountingProcessor(const int thread_count, const bool record_latency, const int task_max_count = 64 * 1024) :
+            m_record_latency(record_latency),
+            m_next_slot(0),
+            m_handled(0)
+    {
+        m_task_max_count = task_max_count;
+
+        /// 每个工作线程一份样本，总数不超过200000
+        for (int i = 0; record_latency && i < thread_count; ++i)
+        {
+            m_samples.emplace_back(new LatencySamples(200000 / static_cast<size_t>(thread_count)));
+        }
+    }
+
+private:
+    const bool m_record_latency;
+    std::vector<std::unique_ptr<LatencySamples>> m_samples;
+    std::atomic<int> m_next_slot;
+
+public:
+    std::atomic<int64_t> m_handled;
+
+protected:
+    virtual void handle_task(std::list<std::shared_ptr<BenchTask>> &tasks)
+    {
+        if (m_record_latency)
+        {
+            static thread_local int s_slot = (-1);
+            static thread_local const void *s_owner = nullptr;
+            if (s_owner != this)
+            {
+                s_owner = this;
+                s_slot = m_next_slot.fetch_add(1) % static_cast<int>(m_samples.size());
+            }
+
+            const int64_t now_ns = metrics_now_ns();
+            for (auto &sp_task : tasks)
+            {
+                m_samples[static_cast<size_t>(s_slot)]->add(now_ns - sp_task->m_push_ns);
+            }
+        }
+
+        m_handled.fetch_add(static_cast<int64_t>(tasks.size()), std::memory_order_relaxed);
+    }
+
+public:
+    void collect(LatencySamples &samples)
+    {
+        for (auto &sp_samples : m_samples)
+        {
+            samples.merge(*sp_samples);
+        }
+    }
+};
+
+/// 只做传递的上游单元
+class ForwardProcessor : public Processor<BenchTask>
+{
+public:
+    ForwardProcessor()
+    {
+        m_task_max_count = 64 * 1024;
+    }
+};
+
+static double elapsed_seconds(const int64_t begin_ns)
+{
+    return static_cast<double>(metrics_now_ns() - begin_ns) / 1e9;
+}
+
+/// 生产者按批投递：批大小为1时调用push_task，否则投递共享批次
+static void produce(Processor<BenchTask> &processor, const int tasks, const int batch)
+{
+    int sent = 0;
+    while (sent < tasks)
+    {
+        const int count = std::min(batch, tasks - sent);
+        if (count == 1)
+        {
+            auto sp_task(Processor<BenchTask>::make_task());
+            sp_task->m_push_ns = metrics_now_ns();
+            processor.push_task(sp_task);
+        }
+        else
+        {
+            auto sp_batch(make_task_batch<BenchTask>());
+            sp_batch->reserve(static_cast<size_t>(count));
+
+            const int64_t now_ns = metrics_now_ns();
+            for (int i = 0; i < count; ++i)
+            {
+                auto sp_task(Processor<BenchTask>::make_task());
+                sp_task->m_push_ns = now_ns;
+                sp_batch->emplace_back(std::move(sp_task));
+            }
+
+            processor.push_batch(sp_batch);
+        }
+
+        sent += count;
+    }
+}
+
+/// push_pop比较的队列后端与调度模式
+struct BenchMode
+{
+    const char *m_name;
+    int m_queue_mode;
+    int m_schedule_mode;
+};
+
+static const BenchMode s_bench_modes[] = {
+        {"list",     PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_SHARED},
+        {"ring",     PROCESSOR_QUEUE_RING, PROCESSOR_SCHEDULE_SHARED},
+        {"steal",    PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_STEAL},
+        {"priority", PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_PRIORITY}
+};
+
+static const BenchMode *find_bench_mode(const std::string &name)
+{
+    for (auto &mode : s_bench_modes)
+    {
+        if (name == mode.m_name)
+        {
+            return &mode;
+        }
+    }
+
+    return nullptr;
+}
+
+/// 等待处理计数追上投递数，最多等待time_out_ms；wait_idle只看队列长度，不能确认任务都已处理
+static bool wait_handled(const std::atomic<int64_t> &handled, const int64_t total, const int time_out_ms = 1000)
+{
+    for (int i = 0; i < time_out_ms / 5 && handled.load() < total; ++i)
+    {
+        thread_sleep_ms(5);
+    }
+
+    return handled.load() >= total;
+}
+
+/// n个生产者、n个工作线程，测吞吐及入队到处理的延迟，并检查投递的任务全部被处理；有任务丢失时返回false
+static bool bench_push_pop(const BenchOptions &options, const BenchMode &mode, const int threads, const int batch)
+{
+    CountingProcessor processor(threads, true);
+    processor.set_queue_mode(mode.m_queue_mode);
+    processor.set_schedule_mode(mode.m_schedule_mode);
+    processor.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+    processor.set_batch_policy(batch);
+    processor.begin_thread(threads);
+
+    const int per_thread = std::max(1, options.m_tasks / threads);
+    const int64_t total = static_cast<int64_t>(per_thread) * threads;
+    const int64_t begin_ns = metrics_now_ns();
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < threads; ++i)
+    {
+        producers.emplace_back([&processor, per_thread, batch]() -> void {
+            produce(processor, per_thread, batch);
+        });
+    }
+
+    for (auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    processor.wait_idle();
+    const bool complete = wait_handled(processor.m_handled, total);
+    const double seconds = elapsed_seconds(begin_ns);
+    processor.end_all_threads();
+
+    LatencySamples samples;
+    processor.collect(samples);
+
+    std::cout << "{\"bench\":\"push_pop\",\"mode\":\"" << mode.m_name << "\",\"threads\":" << threads
+              << ",\"batch\":" << batch << ",\"tasks\":" << total << ",\"lost\":"
+              << total - processor.m_handled.load() << ",\"seconds\":" << seconds << ",\"tasks_per_sec\":"
+              << static_cast<double>(total) / seconds << "," << samples.to_json() << "}" << std::endl;
+
+    return complete;
+}
+
+/// 多个生产者同时写环形队列，每轮检查投递的任务是否都被处理；奇数轮投递16个一批、每次读8个，批次会被拆开
+/// 持有信号的消费者在队首被占位但未写完、或其他消费者正放回拆开的批次时空手而归，
+/// 会让任务永远留在队列中，这类轮次计为stuck，有stuck时返回false
+static bool bench_ring_stress(const BenchOptions &options, const int threads)
+{
+    const int rounds = std::max(1, options.m_iters / 100);
+    const int per_thread = std::max(1, options.m_tasks / threads / rounds);
+    const int64_t total = static_cast<int64_t>(per_thread) * threads;
+
+    int stuck = 0;
+    const int64_t begin_ns = metrics_now_ns();
+    for (int round = 0; round < rounds; ++round)
+    {
+        CountingProcessor processor(threads, false);
+        processor.set_queue_mode(PROCESSOR_QUEUE_RING);
+        processor.set_idle_mode(round % 4 < 2 ? PROCESSOR_IDLE_POLL : PROCESSOR_IDLE_PARK);
+        processor.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+        processor.set_batch_policy(round % 2 == 0 ? 1 : 8);
+        processor.begin_thread(threads);
+
+        const int batch = round % 2 == 0 ? 1 : 16;
+        std::vector<std::thread> producers;
+        for (int i = 0; i < threads; ++i)
+        {
+            producers.emplace_back([&processor, per_thread, batch]() -> void {
+                produce(processor, per_thread, batch);
+            });
+        }
+
+        for (auto &producer : producers)
+        {
+            producer.join();
+        }
+
+        if (!wait_handled(processor.m_handled, total))
+        {
+            ++stuck;
+        }
+
+        processor.end_all_threads();
+    }
+
+    const double seconds = elapsed_seconds(begin_ns);
+
+    std::cout << "{\"bench\":\"ring_stress\",\"threads\":" << threads << ",\"rounds\":" << rounds
+              << ",\"tasks_per_round\":" << total << ",\"stuck_rounds\":" << stuck << ",\"seconds\":" << seconds
+              << "}" << std::endl;
+
+    return stuck == 0;
+}
+
+/// 按任务首字段分片的消费单元
+class CountingShardedProcessor : public ShardedProcessor<BenchTask>
+{
+public:
+    std::atomic<int64_t> m_handled{0};
+
+protected:
+    virtual uint64_t task_key(const std::shared_ptr<BenchTask> &sp_task)
+    {
+        return static_cast<uint64_t>(sp_task->m_push_ns);
+    }
+
+    virtual void handle_task(std::list<std::shared_ptr<BenchTask>> &tasks)
+    {
+        m_handled.fetch_add(static_cast<int64_t>(tasks.size()), std::memory_order_relaxed);
+    }
+};
+
+/// 预热一轮后统计稳定状态下每个任务的堆分配次数（含工作线程），池化后应接近0
+static void bench_alloc_mode(const BenchOptions &options, const char *p_mode, const int queue_mode,
+                             const int schedule_mode, const int batch)
+{
+    CountingProcessor processor(2, false);
+    processor.set_queue_mode(queue_mode);
+    processor.set_schedule_mode(schedule_mode);
+    processor.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+    processor.begin_thread(2);
+
+    produce(processor, options.m_tasks, batch);
+    processor.wait_idle();
+
+    const int64_t begin_allocations = s_allocations.load();
+    produce(processor, options.m_tasks, batch);
+    processor.wait_idle();
+    const int64_t allocations = s_allocations.load() - begin_allocations;
+
+    processor.end_all_threads();
+
+    std::cout << "{\"bench\":\"alloc\",\"mode\":\"" << p_mode << "\",\"batch\":" << batch << ",\"tasks\":"
+              << options.m_tasks << ",\"allocs_per_task\":"
+              << static_cast<double>(allocations) / options.m_tasks << "}" << std::endl;
+}
+
+/// 分片单元按列表或共享批次（上游fan_out的方式）投递，任务跨多个分片，统计投递调用本身的堆分配
+static void bench_alloc_sharded(const BenchOptions &options, const int batch, const bool shared_batch)
+{
+    CountingShardedProcessor processor;
+    processor.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+    processor.begin_thread(4);
+
+    std::list<std::shared_ptr<BenchTask>> tasks;
+    for (int i = 0; i < batch; ++i)
+    {
+        auto sp_task(Processor<BenchTask>::make_task());
+        sp_task->m_push_ns = i;
+        tasks.push_back(sp_task);
+    }
+
+    SP_TASK_BATCH<BenchTask> sp_batch(make_task_batch<BenchTask>(tasks.begin(), tasks.end()));
+
+    const int calls = std::max(1, options.m_tasks / batch);
+    int64_t allocations = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        allocations = 0;
+        for (int i = 0; i < calls; ++i)
+        {
+            const int64_t begin_allocations = s_allocations.load();
+            if (shared_batch)
+            {
+                processor.push_batch(sp_batch);
+            }
+            else
+            {
+                processor.push_task(tasks);
+            }
+
+            allocations += s_allocations.load() - begin_allocations;
+        }
+
+        processor.wait_idle();
+    }
+
+    processor.end_all_threads();
+
+    std::cout << "{\"bench\":\"alloc\",\"mode\":\"" << (shared_batch ? "sharded_batch" : "sharded_list")
+              << "\",\"batch\":" << batch << ",\"tasks\":"
+              << static_cast<int64_t>(calls) * batch << ",\"allocs_per_task\":"
+              << static_cast<double>(allocations) / (static_cast<double>(calls) * batch) << "}" << std::endl;
+}
+
+static void bench_alloc(const BenchOptions &options, const int batch)
+{
+    bench_alloc_mode(options, "list", PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_SHARED, batch);
+    bench_alloc_mode(options, "ring", PROCESSOR_QUEUE_RING, PROCESSOR_SCHEDULE_SHARED, batch);
+    bench_alloc_mode(options, "steal", PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_STEAL, batch);
+    bench_alloc_mode(options, "priority", PROCESSOR_QUEUE_LIST, PROCESSOR_SCHEDULE_PRIORITY, batch);
+
+    if (batch > 1)
+    {
+        bench_alloc_sharded(options, batch, false);
+        bench_alloc_sharded(options, batch, true);
+    }
+}
+
+/// 一个上游连接sinks个下游，测每个任务每个下游的传递开销
+static void bench_fan_out(const BenchOptions &options, const int sinks, const int batch)
+{
+    ForwardProcessor source;
+    source.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+    source.set_batch_policy(batch);
+
+    std::vector<std::unique_ptr<CountingProcessor>> downstream;
+    for (int i = 0; i < sinks; ++i)
+    {
+        downstream.emplace_back(new CountingProcessor(1, false));
+        downstream.back()->set_overflow_policy(PROCESSOR_OVERFLOW_SPILL);
+        downstream.back()->begin_thread(1);
+        source.add_processor(downstream.back().get());
+    }
+
+    source.begin_thread(1);
+
+    const int64_t begin_ns = metrics_now_ns();
+    produce(source, options.m_tasks, batch);
+    source.wait_idle();
+
+    for (auto &sp_sink : downstream)
+    {
+        sp_sink->wait_idle();
+    }
+
+    const double seconds = elapsed_seconds(begin_ns);
+    const double deliveries = static_cast<double>(options.m_tasks) * sinks;
+
+    std::cout << "{\"bench\":\"fan_out\",\"sinks\":" << sinks << ",\"batch\":" << batch << ",\"tasks\":"
+              << options.m_tasks << ",\"seconds\":" << seconds << ",\"deliveries_per_sec\":"
+              << deliveries / seconds << ",\"ns_per_delivery\":" << seconds * 1e9 / deliveries << "}"
+              << std::endl;
+
+    source.end_all_threads();
+    for (auto &sp_sink : downstream)
+    {
+        sp_sink->end_all_threads();
+    }
+}
+
+/// 开启跟踪，上游工作线程在fan_out中向已满的DROP_OLDEST下游投递，下游没有线程，挤出的任务都不会被处理
+/// 每个任务只应在上游有一条handle记录；被挤出的跟踪号若被当成上游正在处理的任务，会多出handle记录，此时返回false
+static bool bench_trace_drop(const BenchOptions &options)
+{
+    const int tasks = std::min(options.m_tasks, 1000);
+    const int source_id = 1;
+
+    Tracer::instance().clear();
+    Tracer::instance().enable(1);
+
+    ForwardProcessor source;
+    source.set_processor_id(source_id);
+    source.set_overflow_policy(PROCESSOR_OVERFLOW_BLOCK, -1);
+
+    CountingProcessor sink(1, false, 4);
+    sink.set_processor_id(source_id + 1);
+    sink.set_overflow_policy(PROCESSOR_OVERFLOW_DROP_OLDEST);
+
+    source.add_processor(&sink);
+    source.begin_thread(1);
+    produce(source, tasks, 1);
+    source.wait_idle();
+    source.end_all_threads();
+
+    Tracer::instance().disable();
+
+    std::vector<TraceRecord> records;
+    Tracer::instance().collect(records);
+
+    std::map<uint64_t, int> handles;
+    int handle_spans = 0;
+    for (auto &record : records)
+    {
+        if (record.m_kind == TRACE_HANDLE && record.m_processor_id == source_id)
+        {
+            ++handles[record.m_trace_id];
+            ++handle_spans;
+        }
+    }
+
+    int duplicates = 0;
+    for (auto &cur : handles)
+    {
+        duplicates += cur.second - 1;
+    }
+
+    ProcessorStats stats;
+    sink.get_stats(stats);
+
+    std::cout << "{\"bench\":\"trace_drop\",\"tasks\":" << tasks << ",\"dropped\":" << stats.m_dropped
+              << ",\"handle_spans\":" << handle_spans << ",\"duplicate_handles\":" << duplicates << "}"
+              << std::endl;
+
+    return handle_spans == tasks && duplicates == 0;
+}
+
+/// 模拟异步I/O：await登记的resume每隔1ms在完成线程中统一调用
+class DelayedCompleter
+{
+public:
+    DelayedCompleter() : m_quit(false), m_thread([this]() -> void { this->run(); }) {}
+
+    ~DelayedCompleter()
+    {
+        m_quit.store(true);
+        m_thread.join();
+    }
+
+private:
+    std::mutex m_lock;
+    std::vector<std::function<void()>> m_pending;
+    std::atomic<bool> m_quit;
+    std::thread m_thread;
+
+    void run()
+    {
+        std::vector<std::function<void()>> ready;
+        while (!m_quit.load())
+        {
+            thread_sleep_ms(1);
+            {
+                std::lock_guard<std::mutex> auto_lock(m_lock);
+                ready.swap(m_pending);
+            }
+
+            for (auto &resume : ready)
+            {
+                resume();
+            }
+
+            ready.clear();
+        }
+    }
+
+public:
+    void post(const std::function<void()> &resume)
+    {
+        std::lock_guard<std::mutex> auto_lock(m_lock);
+        m_pending.push_back(resume);
+    }
+};
+
+/// 每个任务在协程中等待一次模拟I/O后完成
+class AwaitingProcessor : public CoroutineProcessor<BenchTask>
+{
+public:
+    explicit AwaitingProcessor(DelayedCompleter &completer) : m_completer(completer)
+    {
+        m_task_max_count = 64 * 1024;
+    }
+
+private:
+    DelayedCompleter &m_completer;
+
+public:
+    std::atomic<int64_t> m_handled{0};
+
+protected:
+    virtual void handle_task_async(std::shared_ptr<BenchTask> &, CoroutineContext &context)
+    {
+        context.await([this](const std::function<void()> &resume) -> void {
+            this->m_completer.post(resume);
+        });
+
+        m_handled.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+/// 协程单元处理等待I/O的任务并传递给下游，最后排空整条流水线；检查任务全部处理、传递且排空成功，
+/// 同时输出进程CPU时间与耗时之比，协程挂起期间调度线程不应空转
+static bool bench_coroutine(const BenchOptions &options, const int threads)
+{
+    const int tasks = std::min(options.m_tasks, 20000);
+
+    DelayedCompleter completer;
+    CountingProcessor sink(1, false);
+    AwaitingProcessor processor(completer);
+    processor.set_coroutine_policy(1024);
+    processor.add_processor(&sink);
+
+    sink.begin_thread(1);
+    processor.begin_thread(threads);
+
+    const int64_t begin_ns = metrics_now_ns();
+    const std::clock_t begin_cpu = std::clock();
+
+    produce(processor, tasks, 1);
+    const int result = processor.drain(10000);
+
+    const double seconds = elapsed_seconds(begin_ns);
+    const double cpu_seconds = static_cast<double>(std::clock() - begin_cpu) / CLOCKS_PER_SEC;
+
+    std::cout << "{\"bench\":\"coroutine\",\"threads\":" << threads << ",\"tasks\":" << tasks << ",\"handled\":"
+              << processor.m_handled.load() << ",\"forwarded\":" << sink.m_handled.load() << ",\"drained\":"
+              << (result == PROCESSOR_SUCCESS ? "true" : "false") << ",\"seconds\":" << seconds
+              << ",\"cpu_seconds\":" << cpu_seconds << "}" << std::endl;
+
+    return result == PROCESSOR_SUCCESS && processor.m_handled.load() == tasks && sink.m_handled.load() == tasks;
+}
+
+/// PARK模式下从4个线程自动缩容到1个，期间持续投递；检查缩到下限且没有任务因缩容信号而滞留
+static bool bench_autoscale(const BenchOptions &options, const BenchMode &mode)
+{
+    const int round_tasks = 1000;
+    const int max_rounds = std::max(1, options.m_tasks / round_tasks);
+
+    ProcessorAutoscalePolicy policy;
+    policy.m_min_threads = 1;
+    policy.m_max_threads = 4;
+    policy.m_check_ms = 10;
+    policy.m_up_periods = 1000;
+    policy.m_down_periods = 2;
+
+    CountingProcessor processor(1, false);
+    processor.set_queue_mode(mode.m_queue_mode);
+    processor.set_schedule_mode(mode.m_schedule_mode);
+    processor.set_idle_mode(PROCESSOR_IDLE_PARK);
+    processor.set_autoscale_policy(policy);
+    processor.begin_thread(policy.m_max_threads);
+
+    const int64_t begin_ns = metrics_now_ns();
+    int64_t total = 0;
+
+    for (int i = 0; i < max_rounds && processor.get_thread_count() > policy.m_min_threads; ++i)
+    {
+        produce(processor, round_tasks, 1);
+        total += round_tasks;
+        thread_sleep_ms(5);
+    }
+
+    const int thread_count = processor.get_thread_count();
+
+    /// 缩容后剩下的线程仍能处理新任务
+    produce(processor, round_tasks, 1);
+    total += round_tasks;
+
+    const bool complete = wait_handled(processor.m_handled, total);
+    const double seconds = elapsed_seconds(begin_ns);
+    processor.end_all_threads();
+
+    std::cout << "{\"bench\":\"autoscale\",\"mode\":\"" << mode.m_name << "\",\"threads\":"
+              << policy.m_max_threads << ",\"threads_after\":" << thread_count << ",\"tasks\":" << total
+              << ",\"lost\":" << total - processor.m_handled.load() << ",\"seconds\":" << seconds << "}"
+              << std::endl;
+
+    return complete && thread_count == policy.m_min_threads;
+}
+
+/// 消耗约ms毫秒的进程CPU时间
+static __attribute__((noinline)) uint64_t burn_cpu(const int ms)
+{
+    volatile uint64_t value = 0;
+    const std::clock_t end_cpu = std::clock() + static_cast<std::clock_t>(ms) * CLOCKS_PER_SEC / 1000;
+
+    while (std::clock() < end_cpu)
+    {
+        for (int i = 0; i < 10000; ++i)
+        {
+            value = value * 31 + static_cast<uint64_t>(i);
+        }
+    }
+
+    return value;
+}
+
+/// 采样分析器冒烟检查：先后以两种缓冲容量启动并消耗CPU，第二次启动会换缓冲；
+/// 检查有样本写入且导出的折叠栈不为空
+static bool bench_profiler()
+{
+    SamplingProfiler &profiler = SamplingProfiler::instance();
+    profiler.clear();
+
+    ProfilerPolicy policy;
+    policy.m_interval_us = 1000;
+    policy.m_flush_ms = 50;
+
+    bool started = profiler.start(policy);
+    burn_cpu(200);
+
+    policy.m_ring_capacity = PROFILER_RING_CAPACITY * 4;
+    started = profiler.start(policy) && started;
+    burn_cpu(200);
+    profiler.stop();
+
+    std::string folded;
+    profiler.export_folded(folded);
+    const size_t stacks = static_cast<size_t>(std::count(folded.begin(), folded.end(), '\n'));
+
+    std::cout << "{\"bench\":\"profiler\",\"started\":" << (started ? "true" : "false") << ",\"samples\":"
+              << profiler.samples() << ",\"dropped\":" << profiler.dropped() << ",\"stacks\":" << stacks << "}"
+              << std::endl;
+
+    return started && profiler.samples() > 0 && !folded.empty();
+}
+
+/// 两个线程交替唤醒对方，记录从发出信号到对方醒来的时间；park为true时每轮先让对方进入休眠
+template<typename Wake, typename Wait>
+static void ping_pong(const char *p_name, const int iters, const bool park, Wake wake, Wait wait)
+{
+    std::atomic<int64_t> signal_ns(0);
+    LatencySamples samples(static_cast<size_t>(iters));
+
+    std::thread peer([&]() -> void {
+        for (int i = 0; i < iters; ++i)
+        {
+            wait(0);
+            samples.add(metrics_now_ns() - signal_ns.load(std::memory_order_acquire));
+            wake(1);
+        }
+    });
+
+    const int64_t begin_ns = metrics_now_ns();
+    for (int i = 0; i < iters; ++i)
+    {
+        if (park)
+        {
+            thread_sleep_us(200);
+        }
+
+        signal_ns.store(metrics_now_ns(), std::memory_order_release);
+        wake(0);
+        wait(1);
+    }
+
+    const double seconds = elapsed_seconds(begin_ns);
+    peer.join();
+
+    std::cout << "{\"bench\":\"" << p_name << "\",\"mode\":\"" << (park ? "parked" : "hot") << "\",\"iters\":"
+              << iters << ",\"round_trips_per_sec\":" << static_cast<double>(iters) / seconds << ","
+              << samples.to_json() << "}" << std::endl;
+}
+
+static void bench_semphore(const BenchOptions &options, const bool park)
+{
+    Semphore semphores[2];
+    ping_pong("semphore_wake", park ? std::min(options.m_iters, 2000) : options.m_iters, park,
+              [&](const int index) -> void { semphores[index].signal(1); },
+              [&](const int index) -> void { semphores[index].wait(); });
+}
+
+static void bench_event(const BenchOptions &options, const bool park)
+{
+    Event events[2] = {{false, EVENT_AUTO_RESET}, {false, EVENT_AUTO_RESET}};
+    ping_pong("event_wake", park ? std::min(options.m_iters, 2000) : options.m_iters, park,
+              [&](const int index) -> void { events[index].set(); },
+              [&](const int index) -> void { events[index].wait(); });
+}
+
+/// 单次读数的平均开销，sum防止循环被优化掉
+template<typename Watch>
+static void measure_watch(const char *p_clock, const int iters)
+{
+    Watch watch;
+    uint64_t sum = 0;
+
+    const int64_t begin_ns = metrics_now_ns();
+    for (int i = 0; i < iters; ++i)
+    {
+        sum += watch.ElapsedNs();
+    }
+
+    const double ns_per_read = static_cast<double>(metrics_now_ns() - begin_ns) / iters;
+    std::cout << "{\"bench\":\"stopwatch\",\"clock\":\"" << p_clock << "\",\"iters\":" << iters
+              << ",\"ns_per_read\":" << ns_per_read << ",\"checksum\":" << (sum & 1) << "}" << std::endl;
+}
+
+static void bench_stopwatch(const BenchOptions &options)
+{
+    const int iters = options.m_iters * 100;
+    measure_watch<StopWatch>("steady", iters);
+    measure_watch<TscStopWatch>(TscClock::IsTsc() ? "tsc" : "tsc_fallback", iters);
+}
+
+static std::vector<int> parse_list(const std::string &text)
+{
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        int value = std::atoi(item.c_str());
+        if (value > 0)
+        {
+            values.push_back(value);
+        }
+    }
+
+    return values;
+}
+
+static std::vector<std::string> parse_names(const std::string &text)
+{
+    std::vector<std::string> names;
+    std::stringstream ss(text);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+        {
+            names.push_back(item);
+        }
+    }
+
+    return names;
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        size_t pos = arg.find('=');
+        if (pos == std::string::npos)
+        {
+            return false;
+        }
+
+        std::string key(arg.substr(0, pos));
+        std::string value(arg.substr(pos + 1));
+
+        if (key == "threads")
+        {
+            options.m_threads = parse_list(value);
+        }
+        else if (key == "batch")
+        {
+            options.m_batches = parse_list(value);
+        }
+        else if (key == "sinks")
+        {
+            options.m_sinks = parse_list(value);
+        }
+        else if (key == "tasks")
+        {
+            options.m_tasks = std::atoi(value.c_str());
+        }
+        else if (key == "iters")
+        {
+            options.m_iters = std::atoi(value.c_str());
+        }
+        else if (key == "modes")
+        {
+            options.m_modes = parse_names(value);
+        }
+        else if (key == "only")
+        {
+            options.m_only = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    for (auto &name : options.m_modes)
+    {
+        if (find_bench_mode(name) == nullptr)
+        {
+            return false;
+        }
+    }
+
+    return options.m_tasks > 0 && options.m_iters > 0 && !options.m_threads.empty() &&
+           !options.m_batches.empty() && !options.m_sinks.empty() && !options.m_modes.empty();
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "usage: " << argv[0]
+                  << " [threads=1,2,4] [batch=1,16] [sinks=1,2,4] [tasks=N] [iters=N] [modes=list,ring,steal,priority]"
+                     " [only=push_pop|ring_stress|alloc|fan_out|trace_drop|coroutine|autoscale|profiler|semphore|event|stopwatch]" << std::endl;
+        return 1;
+    }
+
+    auto selected = [&](const char *p_name) -> bool {
+        return options.m_only.empty() || options.m_only == p_name;
+    };
+
+    /// 有任务丢失、跟踪记录有误或排空失败时以2退出，便于脚本发现
+    bool complete = true;
+
+    if (selected("push_pop"))
+    {
+        for (auto &name : options.m_modes)
+        {
+            for (auto threads : options.m_threads)
+            {
+                for (auto batch : options.m_batches)
+                {
+                    complete = bench_push_pop(options, *find_bench_mode(name), threads, batch) && complete;
+                }
+            }
+        }
+    }
+
+    if (selected("ring_stress"))
+    {
+        for (auto threads : options.m_threads)
+        {
+            complete = bench_ring_stress(options, threads) && complete;
+        }
+    }
+
+    if (selected("alloc"))
+    {
+        for (auto batch : options.m_batches)
+        {
+            bench_alloc(options, batch);
+        }
+    }
+
+    if (selected("fan_out"))
+    {
+        for (auto sinks : options.m_sinks)
+        {
+            for (auto batch : options.m_batches)
+            {
+                bench_fan_out(options, sinks, batch);
+            }
+        }
+    }
+
+    if (selected("trace_drop"))
+    {
+        complete = bench_trace_drop(options) && complete;
+    }
+
+    if (selected("coroutine"))
+    {
+        for (auto threads : options.m_threads)
+        {
+            complete = bench_coroutine(options, threads) && complete;
+        }
+    }
+
+    if (selected("autoscale"))
+    {
+        for (auto &name : options.m_modes)
+        {
+            complete = bench_autoscale(options, *find_bench_mode(name)) && complete;
+        }
+    }
+
+    if (selected("profiler"))
+    {
+        complete = bench_profiler() && complete;
+    }
+
+    if (selected("semphore"))
+    {
+        bench_semphore(options, false);
+        bench_semphore(options, true);
+    }
+
+    if (selected("event"))
+    {
+        bench_event(options, false);
+        bench_event(options, true);
+    }
+
+    if (selected("stopwatch"))
+    {
+        bench_stopwatch(options);
+    }
+
+    return complete ? 0 : 2;
+}
@@ -0,0 +1,411 @@
+#ifndef __M_COROUTINE_HPP_
+#define __M_COROUTINE_HPP_
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+#include <boost/coroutine2/all.hpp>
+
+#include "mprocessor.hpp"
+
+namespace m_module_space
+{
+
+    enum
+    {
+        COROUTINE_STACK_SIZE = 64 * 1024, /// 默认协程栈大小
+        COROUTINE_MAX_PER_THREAD = 1024   /// 默认每个线程同时运行的协程数上限
+    };
+
+    using CoroutinePush = boost::coroutines2::coroutine<void>::push_type;
+    using CoroutinePull = boost::coroutines2::coroutine<void>::pull_type;
+
+    /// 协程内可用的挂起操作，只能在handle_task_async所在的协程中调用
+    class CoroutineContext : public std::enable_shared_from_this<CoroutineContext>
+    {
+        template<typename> friend class CoroutineProcessor;
+
+    public:
+        CoroutineContext() : m_p_yield(nullptr), m_suspend_reason(SUSPEND_YIELD), m_await_state(AWAIT_RUNNING) {}
+
+        virtual ~CoroutineContext() {}
+
+    private:
+        CoroutineContext(const CoroutineContext &) = delete;
+
+        CoroutineContext &operator=(const CoroutineContext &) = delete;
+
+    private:
+        enum
+        {
+            SUSPEND_YIELD = 0, /// 主动让出，立即重新排队
+            SUSPEND_AWAIT = 1  /// 等待resume
+        };
+
+        enum
+        {
+            AWAIT_RUNNING = 0, /// 已发起异步操作，协程尚未挂起
+            AWAIT_PARKED = 1,  /// 协程已挂起，resume时需要重新排队
+            AWAIT_RESUMED = 2  /// resume已调用
+        };
+
+        CoroutinePull *m_p_yield;
+        int m_suspend_reason;
+        std::atomic<int> m_await_state;
+
+        /// 放回所属线程的就绪队列
+        virtual void wake() = 0;
+
+        void resume()
+        {
+            if (m_await_state.exchange(AWAIT_RESUMED) == AWAIT_PARKED)
+            {
+                wake();
+            }
+        }
+
+        /// 协程挂起后由调度线程调用，返回true表示需要重新排队
+        bool park()
+        {
+            if (m_suspend_reason == SUSPEND_YIELD)
+            {
+                return true;
+            }
+
+            return m_await_state.exchange(AWAIT_PARKED) == AWAIT_RESUMED;
+        }
+
+    public:
+        /// 调用start发起异步操作后挂起，直到传给start的resume被调用；
+        /// resume可在任意线程调用，只生效一次，也可在start返回前调用
+        void await(const std::function<void(const std::function<void()> &resume)> &start)
+        {
+            m_await_state.store(AWAIT_RUNNING);
+
+            std::shared_ptr<CoroutineContext> sp_self(shared_from_this());
+            start([sp_self]() -> void { sp_self->resume(); });
+
+            m_suspend_reason = SUSPEND_AWAIT;
+            (*m_p_yield)();
+        }
+
+        /// 让出线程，排到就绪队列末尾
+        void yield()
+        {
+            m_suspend_reason = SUSPEND_YIELD;
+            (*m_p_yield)();
+        }
+    };
+
+    /// 协程流水线单元：每个任务在独立的有栈协程中处理，等待I/O时只挂起协程，
+    /// 少量工作线程即可同时等待大量任务；投递、传递、排空、统计与Processor相同
+    /// 协程总在创建它的线程上恢复；线程退出前等待本线程的协程全部结束，所以resume必须最终被调用
+    /// 子类实现handle_task_async()，链接时需要boost_context
+    template<typename T>
+    class CoroutineProcessor : public Processor<T>
+    {
+    public:
+        CoroutineProcessor() :
+                m_max_coroutines(COROUTINE_MAX_PER_THREAD),
+                m_stack_size(COROUTINE_STACK_SIZE),
+                m_task_event(false, EVENT_AUTO_RESET)
+        {
+
+        }
+
+        virtual ~CoroutineProcessor() { this->end_all_threads(); }
+
+    private:
+        CoroutineProcessor(const CoroutineProcessor &) = delete;
+
+        CoroutineProcessor &operator=(const CoroutineProcessor &) = delete;
+
+    private:
+        struct Scheduler;
+
+        /// 一个任务及其协程
+        struct Fiber : public CoroutineContext
+        {
+            std::shared_ptr<T> m_task;
+            std::unique_ptr<CoroutinePush> m_co;
+            std::shared_ptr<Scheduler> m_sp_scheduler; /// resume可能晚于线程函数返回，共同持有
+            int64_t m_begin_ns = 0;
+
+            virtual void wake()
+            {
+                m_sp_scheduler->push_ready(std::static_pointer_cast<Fiber>(shared_from_this()));
+            }
+        };
+
+        /// 每个工作线程一个，其他线程只通过push_ready访问
+        struct Scheduler
+        {
+            std::mutex m_lock;
+            std::deque<std::shared_ptr<Fiber>> m_ready;
+            Event m_ready_event{false, EVENT_AUTO_RESET};
+
+            void push_ready(std::shared_ptr<Fiber> &&sp_fiber)
+            {
+                {
+                    std::lock_guard<std::mutex> auto_lock(m_lock);
+                    m_ready.emplace_back(std::move(sp_fiber));
+                }
+
+                m_ready_event.set();
+            }
+        };
+
+        volatile int m_max_coroutines;
+        volatile int m_stack_size;
+
+        Event m_task_event; /// 有新任务，唤醒一个空闲线程
+
+        std::mutex m_scheduler_lock;
+        std::list<std::shared_ptr<Scheduler>> m_schedulers;
+
+    protected:
+        /// 在协程中处理单个任务，可调用context.await()等待异步操作；返回即视为处理完成并传递给下游
+        virtual void handle_task_async(std::shared_ptr<T> &sp_task, CoroutineContext &context) = 0;
+
+        virtual void wake_idle_threads()
+        {
+            Processor<T>::wake_idle_threads();
+
+            std::lock_guard<std::mutex> auto_lock(m_scheduler_lock);
+            for (auto &sp_scheduler : m_schedulers)
+            {
+                sp_scheduler->m_ready_event.set();
+            }
+        }
+
+        /// 空闲线程等待的是m_task_event，同样只唤醒一个
+        virtual void retire_one_thread()
+        {
+            Processor<T>::retire_one_thread();
+            m_task_event.set();
+        }
+
+    private:
+        /// 运行协程直到挂起或结束，结束的任务追加到done
+        void run_fiber(const std::shared_ptr<Fiber> &sp_fiber, std::list<std::shared_ptr<T>> &done, int &active)
+        {
+            (*sp_fiber->m_co)();
+
+            if (*sp_fiber->m_co)
+            {
+                if (sp_fiber->park())
+                {
+                    std::lock_guard<std::mutex> auto_lock(sp_fiber->m_sp_scheduler->m_lock);
+                    sp_fiber->m_sp_scheduler->m_ready.push_back(sp_fiber);
+                }
+
+                return;
+            }
+
+            if (this->m_metrics_timing_flag != 0)
+            {
+                this->m_metrics.on_handle(metrics_now_ns() - sp_fiber->m_begin_ns);
+            }
+
+            ListNodeCache<std::shared_ptr<T>>::append(done, std::move(sp_fiber->m_task));
+            sp_fiber->m_co.reset();
+            --active;
+        }
+
+        void start_fiber(std::shared_ptr<T> &&sp_task, const std::shared_ptr<Scheduler> &sp_scheduler,
+                         std::list<std::shared_ptr<T>> &done, int &active)
+        {
+            auto sp_fiber(std::make_shared<Fiber>());
+            sp_fiber->m_task = std::move(sp_task);
+            sp_fiber->m_sp_scheduler = sp_scheduler;
+
+            if (this->m_metrics_timing_flag != 0)
+            {
+                sp_fiber->m_begin_ns = metrics_now_ns();
+            }
+
+            Fiber *p_fiber = sp_fiber.get();
+            sp_fiber->m_co.reset(new CoroutinePush(boost::coroutines2::fixedsize_stack(m_stack_size),
+                                                   [this, p_fiber](CoroutinePull &yield) -> void {
+                                                       p_fiber->m_p_yield = &yield;
+                                                       this->handle_task_async(p_fiber->m_task, *p_fiber);
+                                                   }));
+
+            ++active;
+            run_fiber(sp_fiber, done, active);
+        }
+
+    protected:
+        /// 调度循环：先恢复就绪的协程，再在上限内取新任务，都没有时才阻塞等待新任务或resume
+        virtual void run_worker(const SP_THREAD_WRAPPER &sp_thread_wrapper)
+        {
+            auto sp_scheduler(std::make_shared<Scheduler>());
+            {
+                std::lock_guard<std::mutex> auto_lock(m_scheduler_lock);
+                m_schedulers.push_back(sp_scheduler);
+            }
+
+            const int wait_ms = (this->m_idle_mode == PROCESSOR_IDLE_PARK) ? (-1) : this->m_thread_timeout_ms;
+            const std::vector<Event *> events{&sp_scheduler->m_ready_event, &m_task_event};
+
+            std::list<std::shared_ptr<T>> tasks;
+            std::list<std::shared_ptr<T>> done;
+            std::deque<std::shared_ptr<Fiber>> ready;
+            int active = 0;
+
+            while (true)
+            {
+                bool quit = sp_thread_wrapper->is_thread_quit();
+                const bool timing = this->m_metrics_timing_flag != 0 || this->m_autoscale_flag != 0;
+                const int64_t begin_ns = timing ? metrics_now_ns() : 0;
+                int progress = 0;
+
+                {
+                    std::lock_guard<std::mutex> auto_lock(sp_scheduler->m_lock);
+                    ready.swap(sp_scheduler->m_ready);
+                }
+
+                for (auto &sp_fiber : ready)
+                {
+                    run_fiber(sp_fiber, done, active);
+                    ++progress;
+                }
+
+                ready.clear();
+
+                /// 退出时不再取新任务，只等已有的协程结束；超时为0的读取只检查一次，协程挂起期间每轮调度不自旋
+                while (!quit && active < m_max_coroutines &&
+                       this->pop_tasks(tasks, 0, nullptr, sp_thread_wrapper.get()) == PROCESSOR_SUCCESS)
+                {
+                    sp_thread_wrapper->m_handle_count.fetch_add(1, std::memory_order_relaxed);
+
+                    /// 只记录排队时间，协程内的处理不单独跟踪
+                    if (Tracer::instance().is_enabled() && Tracer::instance().begin_batch(this->m_processor_id))
+                    {
+                        Tracer::discard_batch();
+                    }
+
+                    /// 还有任务时交给其他空闲线程
+                    if (this->m_task_size.load() > 0)
+                    {
+                        m_task_event.set();
+                    }
+
+                    for (auto &sp_task : tasks)
+                    {
+                        start_fiber(std::move(sp_task), sp_scheduler, done, active);
+                        ++progress;
+                    }
+
+                    ListNodeCache<std::shared_ptr<T>>::recycle(tasks);
+                }
+
+                /// 可能刚取到缩容信号
+                quit = quit || sp_thread_wrapper->is_thread_quit();
+
+                if (!done.empty())
+                {
+                    this->fan_out(done);
+                    this->m_inflight_count -= static_cast<int>(done.size());
+                    ListNodeCache<std::shared_ptr<T>>::recycle(done);
+                }
+
+                if (timing && progress > 0)
+                {
+                    sp_thread_wrapper->m_busy_ns.fetch_add(static_cast<uint64_t>(metrics_now_ns() - begin_ns),
+                                                           std::memory_order_relaxed);
+                }
+
+                if (quit && active == 0)
+                {
+                    break;
+                }
+
+                if (progress > 0)
+                {
+                    continue;
+                }
+
+                int wait_result = EVENT_SUCCESS;
+                if (!quit && active < m_max_coroutines)
+                {
+                    wait_result = Event::wait_any(events, wait_ms);
+                }
+                else
+                {
+                    /// 本线程不能再取任务，交给其他线程
+                    if (this->m_task_size.load() > 0)
+                    {
+                        m_task_event.set();
+                    }
+
+                    wait_result = sp_scheduler->m_ready_event.wait(wait_ms);
+                }
+
+                if (wait_result == EVENT_TIME_OUT && active == 0)
+                {
+                    this->handle_timeout();
+                }
+            }
+
+            std::lock_guard<std::mutex> auto_lock(m_scheduler_lock);
+            m_schedulers.remove(sp_scheduler);
+        }
+
+    public:
+        /// 每个线程同时运行的协程数上限及协程栈大小，须在begin_thread之前设置
+        int set_coroutine_policy(const int max_per_thread, const int stack_size = COROUTINE_STACK_SIZE)
+        {
+            if (max_per_thread <= 0 || stack_size < 16 * 1024)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            m_max_coroutines = max_per_thread;
+            m_stack_size = stack_size;
+            return PROCESSOR_SUCCESS;
+        }
+
+        virtual int
+        push_task(std::list<std::shared_ptr<T>> &task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            return notify_pushed(Processor<T>::push_task(task, p_new_size, wait_time_on_queue_full));
+        }
+
+        virtual int push_task(std::shared_ptr<T> &sp_task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            return notify_pushed(Processor<T>::push_task(sp_task, p_new_size, wait_time_on_queue_full));
+        }
+
+        virtual int push_priority_task(std::shared_ptr<T> &sp_task, const int priority, const int64_t deadline_ns = 0,
+                                       int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            return notify_pushed(Processor<T>::push_priority_task(sp_task, priority, deadline_ns, p_new_size,
+                                                                  wait_time_on_queue_full));
+        }
+
+        virtual int
+        push_batch(const SP_TASK_BATCH<T> &sp_batch, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            return notify_pushed(Processor<T>::push_batch(sp_batch, p_new_size, wait_time_on_queue_full));
+        }
+
+    private:
+        inline int notify_pushed(const int result)
+        {
+            if (result == PROCESSOR_SUCCESS)
+            {
+                m_task_event.set();
+            }
+
+            return result;
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef __M_COUNTERS_HPP_
+#define __M_COUNTERS_HPP_
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "StopWatch.h"
+
+namespace m_module_space
+{
+
+    /// 硬件计数器
+    enum
+    {
+        PERF_COUNTER_CYCLES = 0,
+        PERF_COUNTER_INSTRUCTIONS = 1,
+        PERF_COUNTER_LLC_MISSES = 2,
+        PERF_COUNTER_COUNT = 3
+    };
+
+    /// 当前线程的CPU时间，纳秒
+    static inline int64_t thread_cpu_now_ns()
+    {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        {
+            return 0;
+        }
+
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    /// 一段时间内当前线程的墙钟时间、CPU时间与硬件计数
+    struct ThreadCost
+    {
+        int64_t m_wall_ns = 0;
+        int64_t m_cpu_ns = 0;
+        uint64_t m_counters[PERF_COUNTER_COUNT] = {};
+        bool m_counter_valid[PERF_COUNTER_COUNT] = {}; /// 不允许或不支持的计数器为false
+
+        /// CPU时间占墙钟时间的比例，明显小于1说明在等待
+        inline double cpu_ratio() const
+        {
+            return m_wall_ns <= 0 ? 0.0 : static_cast<double>(m_cpu_ns) / static_cast<double>(m_wall_ns);
+        }
+
+        /// 每周期指令数，计数器不可用时为0
+        inline double ipc() const
+        {
+            if (!m_counter_valid[PERF_COUNTER_CYCLES] || !m_counter_valid[PERF_COUNTER_INSTRUCTIONS] ||
+                m_counters[PERF_COUNTER_CYCLES] == 0)
+            {
+                return 0.0;
+            }
+
+            return static_cast<double>(m_counters[PERF_COUNTER_INSTRUCTIONS]) /
+                   static_cast<double>(m_counters[PERF_COUNTER_CYCLES]);
+        }
+
+        /// 每千条指令的末级缓存未命中数，计数器不可用时为0
+        inline double llc_mpki() const
+        {
+            if (!m_counter_valid[PERF_COUNTER_LLC_MISSES] || !m_counter_valid[PERF_COUNTER_INSTRUCTIONS] ||
+                m_counters[PERF_COUNTER_INSTRUCTIONS] == 0)
+            {
+                return 0.0;
+            }
+
+            return static_cast<double>(m_counters[PERF_COUNTER_LLC_MISSES]) * 1000.0 /
+                   static_cast<double>(m_counters[PERF_COUNTER_INSTRUCTIONS]);
+        }
+
+        void merge(const ThreadCost &other)
+        {
+            m_wall_ns += other.m_wall_ns;
+            m_cpu_ns += other.m_cpu_ns;
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                m_counters[i] += other.m_counters[i];
+                m_counter_valid[i] = m_counter_valid[i] || other.m_counter_valid[i];
+            }
+        }
+
+        std::string to_json() const
+        {
+            static const char *s_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "llc_misses"};
+
+            std::stringstream ss;
+            ss << "{\"wall_ns\":" << m_wall_ns << ",\"cpu_ns\":" << m_cpu_ns << ",\"cpu_ratio\":" << cpu_ratio();
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                if (m_counter_valid[i])
+                {
+                    ss << ",\"" << s_names[i] << "\":" << m_counters[i];
+                }
+            }
+
+            if (m_counter_valid[PERF_COUNTER_CYCLES] && m_counter_valid[PERF_COUNTER_INSTRUCTIONS])
+            {
+                ss << ",\"ipc\":" << ipc();
+            }
+
+            if (m_counter_valid[PERF_COUNTER_LLC_MISSES] && m_counter_valid[PERF_COUNTER_INSTRUCTIONS])
+            {
+                ss << ",\"llc_mpki\":" << llc_mpki();
+            }
+
+            ss << "}";
+            return ss.str();
+        }
+    };
+
+    /// 当前线程的perf_event计数器，每个线程第一次读取时打开，线程退出时关闭
+    /// 所有计数器作为一组打开，内核同时调度、一次读出，IPC等比值来自同一段计数时间
+    /// 只统计用户态；没有权限（perf_event_paranoid）、没有PMU（部分虚拟机）或内核不支持时对应计数器不可用
+    class PerfCounters
+    {
+    public:
+        static PerfCounters &local()
+        {
+            static thread_local PerfCounters s_counters;
+            return s_counters;
+        }
+
+        ~PerfCounters()
+        {
+#if defined(__linux__)
+            /// 先关闭组员再关闭组长
+            for (int i = m_group_size - 1; i >= 0; --i)
+            {
+                close(m_fds[m_group[i]]);
+            }
+#endif
+        }
+
+    private:
+        PerfCounters() : m_group_size(0)
+        {
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                m_fds[i] = (-1);
+                m_group[i] = (-1);
+            }
+
+            open_all();
+        }
+
+        PerfCounters(const PerfCounters &) = delete;
+
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+    private:
+        int m_fds[PERF_COUNTER_COUNT];
+        int m_group[PERF_COUNTER_COUNT]; /// 按打开顺序排列的计数器下标，即组读取结果中的顺序，第一个为组长
+        int m_group_size;
+
+#if defined(__linux__)
+        static int open_counter(const uint32_t type, const uint64_t config, const int group_fd)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+        }
+#endif
+
+        /// 周期数作为组长，其余计数器加入它的组；组长打不开时由下一个能打开的计数器作组长
+        void open_all()
+        {
+#if defined(__linux__)
+            static const uint64_t s_configs[PERF_COUNTER_COUNT] = {
+                    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                const int group_fd = m_group_size > 0 ? m_fds[m_group[0]] : (-1);
+                m_fds[i] = open_counter(PERF_TYPE_HARDWARE, s_configs[i], group_fd);
+                if (m_fds[i] >= 0)
+                {
+                    m_group[m_group_size++] = i;
+                }
+            }
+#endif
+        }
+
+    public:
+        /// 计数器是否可用
+        inline bool valid(const int index) const
+        {
+            return m_fds[index] >= 0;
+        }
+
+        /// 一次读出整组的累计值，被复用时按实际计数时间放大，整组都没有被调度过时均不可用
+        void read_all(uint64_t values[PERF_COUNTER_COUNT], bool valid[PERF_COUNTER_COUNT]) const
+        {
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                values[i] = 0;
+                valid[i] = false;
+            }
+
+#if defined(__linux__)
+            if (m_group_size == 0)
+            {
+                return;
+            }
+
+            /// nr、time_enabled、time_running，之后按加入顺序为各计数器的值
+            uint64_t data[3 + PERF_COUNTER_COUNT] = {};
+            const ssize_t size = static_cast<ssize_t>(sizeof(uint64_t) * (3 + m_group_size));
+            if (read(m_fds[m_group[0]], data, sizeof(data)) != size || data[0] != static_cast<uint64_t>(m_group_size) ||
+                data[2] == 0)
+            {
+                return;
+            }
+
+            for (int k = 0; k < m_group_size; ++k)
+            {
+                const uint64_t value = data[3 + k];
+                values[m_group[k]] = data[2] < data[1]
+                                     ? static_cast<uint64_t>(static_cast<double>(value) * data[1] / data[2]) : value;
+                valid[m_group[k]] = true;
+            }
+#endif
+        }
+    };
+
+    /// 同一区间内同时记录墙钟时间、当前线程CPU时间及可选的硬件计数
+    /// 只能在创建它的线程上使用，CPU时间与硬件计数都是该线程的
+    class ThreadStopWatch
+    {
+    public:
+        /// counters为false时不读取硬件计数器，只多一次clock_gettime
+        explicit ThreadStopWatch(const bool counters = false) : m_counters_flag(counters)
+        {
+            restart();
+        }
+
+    private:
+        bool m_counters_flag;
+        TscStopWatch m_wall_watch;
+        int64_t m_start_cpu_ns = 0;
+        uint64_t m_start_counters[PERF_COUNTER_COUNT] = {};
+        bool m_start_valid[PERF_COUNTER_COUNT] = {};
+
+    public:
+        /// 墙钟区间包含CPU时间与计数器的区间，cpu_ratio不会因读取顺序超过1
+        void restart()
+        {
+            m_wall_watch.Restart();
+            m_start_cpu_ns = thread_cpu_now_ns();
+
+            if (m_counters_flag)
+            {
+                PerfCounters::local().read_all(m_start_counters, m_start_valid);
+            }
+        }
+
+        /// 从开始到现在的开销
+        void elapsed(ThreadCost &cost) const
+        {
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                cost.m_counters[i] = 0;
+                cost.m_counter_valid[i] = false;
+            }
+
+            if (m_counters_flag)
+            {
+                uint64_t values[PERF_COUNTER_COUNT];
+                bool valid[PERF_COUNTER_COUNT];
+                PerfCounters::local().read_all(values, valid);
+
+                for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+                {
+                    if (valid[i] && m_start_valid[i] && values[i] >= m_start_counters[i])
+                    {
+                        cost.m_counters[i] = values[i] - m_start_counters[i];
+                        cost.m_counter_valid[i] = true;
+                    }
+                }
+            }
+
+            cost.m_cpu_ns = thread_cpu_now_ns() - m_start_cpu_ns;
+            cost.m_wall_ns = static_cast<int64_t>(m_wall_watch.ElapsedNs());
+        }
+    };
+
+    /// 多个线程的ThreadCost累加，只用relaxed原子操作，用于按流水线单元汇总
+    class ThreadCostCounter
+    {
+    public:
+        ThreadCostCounter()
+        {
+            reset();
+        }
+
+    private:
+        ThreadCostCounter(const ThreadCostCounter &) = delete;
+
+        ThreadCostCounter &operator=(const ThreadCostCounter &) = delete;
+
+    private:
+        std::atomic<int64_t> m_wall_ns;
+        std::atomic<int64_t> m_cpu_ns;
+        std::atomic<uint64_t> m_counters[PERF_COUNTER_COUNT];
+        std::atomic<bool> m_counter_valid[PERF_COUNTER_COUNT];
+
+    public:
+        void add(const ThreadCost &cost)
+        {
+            m_wall_ns.fetch_add(cost.m_wall_ns, std::memory_order_relaxed);
+            m_cpu_ns.fetch_add(cost.m_cpu_ns, std::memory_order_relaxed);
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                if (cost.m_counter_valid[i])
+                {
+                    m_counters[i].fetch_add(cost.m_counters[i], std::memory_order_relaxed);
+                    m_counter_valid[i].store(true, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// 累加到cost
+        void collect(ThreadCost &cost) const
+        {
+            ThreadCost cur;
+            cur.m_wall_ns = m_wall_ns.load(std::memory_order_relaxed);
+            cur.m_cpu_ns = m_cpu_ns.load(std::memory_order_relaxed);
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                cur.m_counters[i] = m_counters[i].load(std::memory_order_relaxed);
+                cur.m_counter_valid[i] = m_counter_valid[i].load(std::memory_order_relaxed);
+            }
+
+            cost.merge(cur);
+        }
+
+        void reset()
+        {
+            m_wall_ns.store(0, std::memory_order_relaxed);
+            m_cpu_ns.store(0, std::memory_order_relaxed);
+
+            for (int i = 0; i < PERF_COUNTER_COUNT; ++i)
+            {
+                m_counters[i].store(0, std::memory_order_relaxed);
+                m_counter_valid[i].store(false, std::memory_order_relaxed);
+            }
+        }
+    };
+
+}
+
+#endif
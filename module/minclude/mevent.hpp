@@ -1,107 +1,311 @@
-#ifndef __M_EVENT_HPP_
-#define __M_EVENT_HPP_
-
-#include <chrono>
-#include <mutex>
-#include <condition_variable>
-
-namespace m_module_space
-{
-    enum
-    {
-        EVENT_FAIL = (-1),
-        EVENT_SUCCESS = 0,
-        EVENT_TIME_OUT = 1
-    };
-
-    class Event
-    {
-    public:
-        Event(bool init_state = false) :
-                m_signal(init_state),
-                m_blocked(0)
-        {
-
-        }
-
-        ~Event() {}
-
-    private:
-        Event(const Event &) = delete;
-
-        Event(Event &&) = delete;
-
-        Event &operator=(const Event &) = delete;
-
-    private:
-        std::mutex m_mtx;
-        std::condition_variable m_cv;
-        bool m_signal;
-        int m_blocked;
-
-    public:
-        int wait(const int time_out_ms = (-1))
-        {
-            std::unique_lock<std::mutex> ul(m_mtx);
-
-            if (m_signal)
-            {
-                return EVENT_SUCCESS;
-            }
-            else
-            {
-                ++m_blocked;
-            }
-
-            if (time_out_ms >= 0)
-            {
-                std::chrono::milliseconds wait_time_ms(time_out_ms);
-                auto result = m_cv.wait_for(ul, wait_time_ms, [&] { return m_signal; });
-                --m_blocked;
-
-                if (result)
-                {
-                    return EVENT_SUCCESS;
-                }
-                else
-                {
-                    return EVENT_TIME_OUT;
-                }
-            }
-            else
-            {
-                m_cv.wait(ul, [&] { return m_signal; });
-                --m_blocked;
-                return EVENT_SUCCESS;
-            }
-        }
-
-        void set()
-        {
-            std::lock_guard<std::mutex> lg(m_mtx);
-
-            if (m_signal)
-            {
-                return;
-            }
-
-            m_signal = true;
-
-            if (m_blocked > 0)
-            {
-                m_cv.notify_all();
-            }
-        }
-
-        void reset()
-        {
-            m_mtx.lock();
-            m_signal = false;
-            m_mtx.unlock();
-        }
-
-    };
-
-}
-
-#endif
\ No newline at end of file
+#ifndef __M_EVENT_HPP_
+#define __M_EVENT_HPP_
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <list>
+#include <cstdint>
+
+namespace m_module_space
+{
+    enum
+    {
+        EVENT_FAIL = (-1),
+        EVENT_SUCCESS = 0,
+        EVENT_TIME_OUT = 1
+    };
+
+    /// 事件复位方式
+    enum
+    {
+        EVENT_MANUAL_RESET = 0, /// set()后一直有信号，直到调用reset()
+        EVENT_AUTO_RESET = 1    /// 一次成功的等待即清除信号，每次set()只放行一个等待者
+    };
+
+    class Event
+    {
+    public:
+        Event(bool init_state = false, const int reset_mode = EVENT_MANUAL_RESET) :
+                m_signal(init_state),
+                m_blocked(0),
+                m_reset_mode(reset_mode)
+        {
+
+        }
+
+        ~Event() {}
+
+    private:
+        Event(const Event &) = delete;
+
+        Event(Event &&) = delete;
+
+        Event &operator=(const Event &) = delete;
+
+    private:
+        /// wait_any()/wait_all()的等待者，登记到每个事件上，任一事件set()时递增m_seq并唤醒
+        struct MultiWaiter
+        {
+            std::mutex m_mtx;
+            std::condition_variable m_cv;
+            uint64_t m_seq = 0;
+        };
+
+        std::mutex m_mtx;
+        std::condition_variable m_cv;
+        std::atomic<bool> m_signal;
+        std::atomic<int> m_blocked; /// 包含wait()与登记的MultiWaiter，为0时set()不加锁
+        const int m_reset_mode;
+        std::list<MultiWaiter *> m_multi_waiters;
+
+    private:
+        /// 有信号时返回true，自动复位事件同时清除信号
+        inline bool try_consume()
+        {
+            if (!m_signal.load())
+            {
+                return false;
+            }
+
+            return m_reset_mode == EVENT_AUTO_RESET ? m_signal.exchange(false) : true;
+        }
+
+        void add_multi_waiter(MultiWaiter *p_waiter)
+        {
+            std::lock_guard<std::mutex> lg(m_mtx);
+            m_multi_waiters.push_back(p_waiter);
+            ++m_blocked;
+        }
+
+        void remove_multi_waiter(MultiWaiter *p_waiter)
+        {
+            std::lock_guard<std::mutex> lg(m_mtx);
+
+            for (auto itr = m_multi_waiters.begin(); itr != m_multi_waiters.end(); ++itr)
+            {
+                if (*itr == p_waiter)
+                {
+                    m_multi_waiters.erase(itr);
+                    --m_blocked;
+                    return;
+                }
+            }
+        }
+
+        /// 所有事件都有信号时一次取走；自动复位事件中途被抢走则归还已取走的信号
+        static bool try_consume_all(const std::vector<Event *> &events)
+        {
+            for (auto p_event : events)
+            {
+                if (!p_event->m_signal.load())
+                {
+                    return false;
+                }
+            }
+
+            for (size_t i = 0; i < events.size(); ++i)
+            {
+                if (events[i]->m_reset_mode == EVENT_AUTO_RESET && !events[i]->m_signal.exchange(false))
+                {
+                    for (size_t k = 0; k < i; ++k)
+                    {
+                        if (events[k]->m_reset_mode == EVENT_AUTO_RESET)
+                        {
+                            events[k]->set();
+                        }
+                    }
+
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// 在多个事件上等待，wait_all为false时任一事件满足即返回并写入其下标
+        static int wait_multiple(const std::vector<Event *> &events, const bool wait_all, const int time_out_ms,
+                                 int *p_index)
+        {
+            if (events.empty())
+            {
+                return EVENT_FAIL;
+            }
+
+            for (auto p_event : events)
+            {
+                if (p_event == nullptr)
+                {
+                    return EVENT_FAIL;
+                }
+            }
+
+            auto check = [&]() -> bool {
+                if (wait_all)
+                {
+                    return try_consume_all(events);
+                }
+
+                for (size_t i = 0; i < events.size(); ++i)
+                {
+                    if (events[i]->try_consume())
+                    {
+                        if (p_index != nullptr)
+                        {
+                            *p_index = static_cast<int>(i);
+                        }
+
+                        return true;
+                    }
+                }
+
+                return false;
+            };
+
+            if (check())
+            {
+                return EVENT_SUCCESS;
+            }
+
+            MultiWaiter waiter;
+            for (auto p_event : events)
+            {
+                p_event->add_multi_waiter(&waiter);
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(time_out_ms);
+            int result = EVENT_TIME_OUT;
+
+            while (true)
+            {
+                uint64_t seq = 0;
+                {
+                    std::lock_guard<std::mutex> lg(waiter.m_mtx);
+                    seq = waiter.m_seq;
+                }
+
+                /// 先记下序号再检查，检查之后的set()必然改变序号
+                if (check())
+                {
+                    result = EVENT_SUCCESS;
+                    break;
+                }
+
+                std::unique_lock<std::mutex> ul(waiter.m_mtx);
+                auto changed = [&] { return waiter.m_seq != seq; };
+
+                if (time_out_ms < 0)
+                {
+                    waiter.m_cv.wait(ul, changed);
+                }
+                else if (!waiter.m_cv.wait_until(ul, deadline, changed))
+                {
+                    ul.unlock();
+                    result = check() ? EVENT_SUCCESS : EVENT_TIME_OUT;
+                    break;
+                }
+            }
+
+            for (auto p_event : events)
+            {
+                p_event->remove_multi_waiter(&waiter);
+            }
+
+            return result;
+        }
+
+    public:
+        int wait(const int time_out_ms = (-1))
+        {
+            /// 有信号时不加锁
+            if (try_consume())
+            {
+                return EVENT_SUCCESS;
+            }
+
+            std::unique_lock<std::mutex> ul(m_mtx);
+            ++m_blocked;
+
+            bool result = true;
+            if (time_out_ms >= 0)
+            {
+                std::chrono::milliseconds wait_time_ms(time_out_ms);
+                result = m_cv.wait_for(ul, wait_time_ms, [&] { return try_consume(); });
+            }
+            else
+            {
+                m_cv.wait(ul, [&] { return try_consume(); });
+            }
+
+            --m_blocked;
+            return result ? EVENT_SUCCESS : EVENT_TIME_OUT;
+        }
+
+        void set()
+        {
+            if (m_signal.exchange(true))
+            {
+                return;
+            }
+
+            /// 没有等待者时不加锁
+            if (m_blocked.load() == 0)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lg(m_mtx);
+
+            if (m_reset_mode == EVENT_AUTO_RESET)
+            {
+                m_cv.notify_one();
+            }
+            else
+            {
+                m_cv.notify_all();
+            }
+
+            for (auto p_waiter : m_multi_waiters)
+            {
+                std::lock_guard<std::mutex> waiter_lg(p_waiter->m_mtx);
+                ++p_waiter->m_seq;
+                p_waiter->m_cv.notify_all();
+            }
+        }
+
+        void reset()
+        {
+            m_signal.store(false);
+        }
+
+        /// 当前是否有信号，不清除信号
+        inline bool is_set() const
+        {
+            return m_signal.load();
+        }
+
+        /// 读取复位方式
+        inline int get_reset_mode() const
+        {
+            return m_reset_mode;
+        }
+
+        /// 等待任一事件，成功时p_index写入该事件在events中的下标，自动复位事件只清除该事件
+        static int wait_any(const std::vector<Event *> &events, const int time_out_ms = (-1), int *p_index = nullptr)
+        {
+            return wait_multiple(events, false, time_out_ms, p_index);
+        }
+
+        /// 等待所有事件同时有信号，自动复位事件一并清除；events中不能有重复的自动复位事件
+        static int wait_all(const std::vector<Event *> &events, const int time_out_ms = (-1))
+        {
+            return wait_multiple(events, true, time_out_ms, nullptr);
+        }
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,354 @@
+#ifndef __M_HISTOGRAM_HPP_
+#define __M_HISTOGRAM_HPP_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdint>
+
+namespace m_module_space
+{
+
+    enum
+    {
+        HISTOGRAM_DEFAULT_PRECISION_BITS = 7, /// 桶宽不超过值的2^-(7-1)，分位数相对误差不超过2^-6，约1.6%
+        HISTOGRAM_MAX_PRECISION_BITS = 16,
+        HISTOGRAM_DEFAULT_RANGE_BITS = 40,    /// 可精确记录的最大值为2^40-1，纳秒下约18分钟，更大的值计入最后一个桶
+        HISTOGRAM_SHARD_COUNT = 16            /// 按线程分片记录，避免共享写
+    };
+
+    /// 对数-线性分桶：小于2^precision_bits的值各占一个桶，
+    /// 之后每个2的幂区间再等分为2^(precision_bits-1)个桶，桶宽与值的比例不超过2^-(precision_bits-1)
+    class HistogramLayout
+    {
+    public:
+        HistogramLayout(const int precision_bits = HISTOGRAM_DEFAULT_PRECISION_BITS,
+                        const int range_bits = HISTOGRAM_DEFAULT_RANGE_BITS)
+        {
+            m_precision_bits = precision_bits < 1 ? 1 : (precision_bits > HISTOGRAM_MAX_PRECISION_BITS
+                                                          ? HISTOGRAM_MAX_PRECISION_BITS : precision_bits);
+            m_range_bits = range_bits < m_precision_bits ? m_precision_bits : (range_bits > 64 ? 64 : range_bits);
+            m_half_count = 1 << (m_precision_bits - 1);
+            m_bucket_count = index_of_unclamped(m_range_bits == 64 ? UINT64_MAX
+                                                                    : (static_cast<uint64_t>(1) << m_range_bits) - 1) + 1;
+        }
+
+    private:
+        int m_precision_bits;
+        int m_range_bits;
+        int m_half_count;
+        int m_bucket_count;
+
+        inline int index_of_unclamped(const uint64_t value) const
+        {
+            if (value < (static_cast<uint64_t>(1) << m_precision_bits))
+            {
+                return static_cast<int>(value);
+            }
+
+            const int shift = 63 - __builtin_clzll(value) - (m_precision_bits - 1);
+            return shift * m_half_count + static_cast<int>(value >> shift);
+        }
+
+    public:
+        inline int precision_bits() const
+        {
+            return m_precision_bits;
+        }
+
+        inline int range_bits() const
+        {
+            return m_range_bits;
+        }
+
+        inline int bucket_count() const
+        {
+            return m_bucket_count;
+        }
+
+        /// 分桶参数相同，同一下标的桶对应同一区间
+        inline bool same_as(const HistogramLayout &other) const
+        {
+            return m_precision_bits == other.m_precision_bits && m_range_bits == other.m_range_bits;
+        }
+
+        inline int index_of(const uint64_t value) const
+        {
+            const int index = index_of_unclamped(value);
+            return index < m_bucket_count ? index : m_bucket_count - 1;
+        }
+
+        /// 第index个桶的下界
+        inline uint64_t bucket_lower(const int index) const
+        {
+            if (index < (m_half_count << 1))
+            {
+                return static_cast<uint64_t>(index);
+            }
+
+            const int shift = index / m_half_count - 1;
+            return static_cast<uint64_t>(index - shift * m_half_count) << shift;
+        }
+
+        /// 第index个桶的上界（含）
+        inline uint64_t bucket_upper(const int index) const
+        {
+            if (index + 1 >= m_bucket_count)
+            {
+                return UINT64_MAX;
+            }
+
+            return bucket_lower(index + 1) - 1;
+        }
+    };
+
+    /// LatencyHistogram的快照，可跨直方图合并（分桶参数须相同）
+    struct LatencySnapshot
+    {
+        HistogramLayout m_layout;
+        std::vector<uint64_t> m_buckets;
+        uint64_t m_count = 0;
+        uint64_t m_sum = 0;
+        uint64_t m_min = UINT64_MAX;
+        uint64_t m_max = 0;
+
+        inline double mean() const
+        {
+            return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / static_cast<double>(m_count);
+        }
+
+        inline uint64_t min() const
+        {
+            return m_count == 0 ? 0 : m_min;
+        }
+
+        /// 分位数，返回所在桶的上界，限制在[min, max]内；ratio取值[0, 1]
+        uint64_t percentile(const double ratio) const
+        {
+            if (m_count == 0)
+            {
+                return 0;
+            }
+
+            uint64_t target = static_cast<uint64_t>(ratio * static_cast<double>(m_count));
+            if (target >= m_count)
+            {
+                target = m_count - 1;
+            }
+
+            uint64_t seen = 0;
+            for (size_t i = 0; i < m_buckets.size(); ++i)
+            {
+                seen += m_buckets[i];
+                if (seen > target)
+                {
+                    uint64_t upper = m_layout.bucket_upper(static_cast<int>(i));
+                    upper = upper < m_max ? upper : m_max;
+                    return upper > m_min ? upper : m_min;
+                }
+            }
+
+            return m_max;
+        }
+
+        /// 合并另一个快照；分桶参数不同时同一下标的桶对应不同区间，不合并并返回false
+        bool merge(const LatencySnapshot &other)
+        {
+            if (other.m_buckets.empty())
+            {
+                return true;
+            }
+
+            if (m_buckets.empty())
+            {
+                m_layout = other.m_layout;
+                m_buckets.assign(other.m_buckets.size(), 0);
+            }
+            else if (!m_layout.same_as(other.m_layout))
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < m_buckets.size(); ++i)
+            {
+                m_buckets[i] += other.m_buckets[i];
+            }
+
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_min = m_min < other.m_min ? m_min : other.m_min;
+            m_max = m_max > other.m_max ? m_max : other.m_max;
+            return true;
+        }
+
+        /// 常用统计量，单位与记录的值相同
+        std::string to_json() const
+        {
+            std::stringstream ss;
+            ss << "{\"count\":" << m_count << ",\"mean\":" << mean() << ",\"min\":" << min()
+               << ",\"p50\":" << percentile(0.5) << ",\"p90\":" << percentile(0.9)
+               << ",\"p99\":" << percentile(0.99) << ",\"p999\":" << percentile(0.999)
+               << ",\"max\":" << m_max << "}";
+            return ss.str();
+        }
+    };
+
+    /// 对数-线性延迟直方图，记录只做relaxed原子累加
+    /// 每个线程写自己的分片，分片在线程第一次记录时创建，线程数超过HISTOGRAM_SHARD_COUNT时多个线程共用一个分片
+    /// collect()逐个读取分片合并，不阻塞记录
+    class LatencyHistogram
+    {
+    public:
+        LatencyHistogram(const int precision_bits = HISTOGRAM_DEFAULT_PRECISION_BITS,
+                         const int range_bits = HISTOGRAM_DEFAULT_RANGE_BITS) :
+                m_layout(precision_bits, range_bits)
+        {
+            for (auto &shard : m_shards)
+            {
+                shard.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~LatencyHistogram()
+        {
+            for (auto &shard : m_shards)
+            {
+                delete shard.load(std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    private:
+        struct Shard
+        {
+            explicit Shard(const int bucket_count) : m_buckets(new std::atomic<uint64_t>[bucket_count])
+            {
+                for (int i = 0; i < bucket_count; ++i)
+                {
+                    m_buckets[i].store(0, std::memory_order_relaxed);
+                }
+            }
+
+            std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+            std::atomic<uint64_t> m_sum{0};
+            std::atomic<uint64_t> m_min{UINT64_MAX};
+            std::atomic<uint64_t> m_max{0};
+            char m_pad[64]; /// 相邻分片的计数不共享缓存行
+        };
+
+        const HistogramLayout m_layout;
+        std::atomic<Shard *> m_shards[HISTOGRAM_SHARD_COUNT];
+
+        inline Shard &local_shard()
+        {
+            static std::atomic<unsigned int> s_next_index(0);
+            static thread_local unsigned int s_index = s_next_index.fetch_add(1, std::memory_order_relaxed);
+
+            std::atomic<Shard *> &slot = m_shards[s_index % HISTOGRAM_SHARD_COUNT];
+            Shard *p_shard = slot.load(std::memory_order_acquire);
+            if (p_shard != nullptr)
+            {
+                return *p_shard;
+            }
+
+            /// 共用分片的线程同时创建时只保留一个
+            Shard *p_new_shard = new Shard(m_layout.bucket_count());
+            if (!slot.compare_exchange_strong(p_shard, p_new_shard, std::memory_order_acq_rel))
+            {
+                delete p_new_shard;
+                return *p_shard;
+            }
+
+            return *p_new_shard;
+        }
+
+    public:
+        inline const HistogramLayout &layout() const
+        {
+            return m_layout;
+        }
+
+        inline void record(const uint64_t value)
+        {
+            Shard &shard = local_shard();
+            /// 总数在collect()时由各桶累加得到，热路径少一次原子操作
+            shard.m_buckets[m_layout.index_of(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.m_sum.fetch_add(value, std::memory_order_relaxed);
+
+            uint64_t cur = shard.m_min.load(std::memory_order_relaxed);
+            while (value < cur && !shard.m_min.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            {
+            }
+
+            cur = shard.m_max.load(std::memory_order_relaxed);
+            while (value > cur && !shard.m_max.compare_exchange_weak(cur, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        /// 累加到snapshot，与记录并发时各计数之间可能相差正在进行的几次记录；
+        /// snapshot已有其他分桶参数的数据时不累加，返回false
+        bool collect(LatencySnapshot &snapshot) const
+        {
+            LatencySnapshot cur;
+            cur.m_layout = m_layout;
+            cur.m_buckets.assign(static_cast<size_t>(m_layout.bucket_count()), 0);
+
+            for (const auto &slot : m_shards)
+            {
+                const Shard *p_shard = slot.load(std::memory_order_acquire);
+                if (p_shard == nullptr)
+                {
+                    continue;
+                }
+
+                for (int i = 0; i < m_layout.bucket_count(); ++i)
+                {
+                    const uint64_t count = p_shard->m_buckets[i].load(std::memory_order_relaxed);
+                    cur.m_buckets[i] += count;
+                    cur.m_count += count;
+                }
+
+                cur.m_sum += p_shard->m_sum.load(std::memory_order_relaxed);
+
+                const uint64_t shard_min = p_shard->m_min.load(std::memory_order_relaxed);
+                const uint64_t shard_max = p_shard->m_max.load(std::memory_order_relaxed);
+                cur.m_min = cur.m_min < shard_min ? cur.m_min : shard_min;
+                cur.m_max = cur.m_max > shard_max ? cur.m_max : shard_max;
+            }
+
+            return snapshot.merge(cur);
+        }
+
+        /// 清零，与记录并发时个别计数可能落在清零之前
+        void reset()
+        {
+            for (auto &slot : m_shards)
+            {
+                Shard *p_shard = slot.load(std::memory_order_acquire);
+                if (p_shard == nullptr)
+                {
+                    continue;
+                }
+
+                for (int i = 0; i < m_layout.bucket_count(); ++i)
+                {
+                    p_shard->m_buckets[i].store(0, std::memory_order_relaxed);
+                }
+
+                p_shard->m_sum.store(0, std::memory_order_relaxed);
+                p_shard->m_min.store(UINT64_MAX, std::memory_order_relaxed);
+                p_shard->m_max.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+}
+
+#endif
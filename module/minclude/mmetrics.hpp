@@ -0,0 +1,196 @@
+#ifndef __M_METRICS_HPP_
+#define __M_METRICS_HPP_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include "mhistogram.hpp"
+
+namespace m_module_space
+{
+
+    enum
+    {
+        METRICS_SHARD_COUNT = 16,     /// 热路径按线程分片计数，避免共享写
+        METRICS_BATCH_RANGE_BITS = 24 /// 批大小直方图的范围，更大的批计入最后一个桶
+    };
+
+    /// 单调时钟，纳秒
+    static inline int64_t metrics_now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// 转义JSON字符串中的引号与反斜杠，控制字符替换为空格
+    static inline std::string metrics_json_escape(const std::string &text)
+    {
+        std::string result;
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                result += ' ';
+            }
+            else
+            {
+                result += c;
+            }
+        }
+
+        return result;
+    }
+
+    /// 流水线单元的统计快照
+    struct ProcessorStats
+    {
+        int m_processor_id = 0;
+        std::string m_processor_name;
+
+        uint64_t m_enqueued = 0; /// 接受的任务数，包括写入暂存队列的任务
+        uint64_t m_dequeued = 0; /// 被工作线程取走的任务数
+        uint64_t m_dropped = 0;  /// 拒收或被挤出的任务数
+        uint64_t m_expired = 0;  /// 超过截止时间、未处理即丢弃的任务数
+        int m_queue_depth = 0;
+        int m_queue_high_water = 0;
+        int m_spill_size = 0;
+
+        LatencySnapshot m_batch_size;      /// 每次pop_task读到的任务数
+        LatencySnapshot m_queue_time_ns;   /// 每批中最早入队任务的排队时间，set_metrics_timing(true)后才有
+        LatencySnapshot m_handle_time_ns;  /// handle_task耗时，set_metrics_timing(true)后才有
+    };
+
+    /// 流水线单元的运行计数，按线程分片；分布用对数-线性直方图记录，分位数相对误差约1.6%
+    class ProcessorMetrics
+    {
+    public:
+        ProcessorMetrics() :
+                m_batch_size(HISTOGRAM_DEFAULT_PRECISION_BITS, METRICS_BATCH_RANGE_BITS),
+                m_queue_high_water(0)
+        {
+
+        }
+
+    private:
+        ProcessorMetrics(const ProcessorMetrics &) = delete;
+
+        ProcessorMetrics &operator=(const ProcessorMetrics &) = delete;
+
+    private:
+        struct Shard
+        {
+            std::atomic<uint64_t> m_enqueued{0};
+            std::atomic<uint64_t> m_dequeued{0};
+            std::atomic<uint64_t> m_dropped{0};
+            std::atomic<uint64_t> m_expired{0};
+            char m_pad[64]; /// 相邻分片不共享缓存行
+        };
+
+        Shard m_shards[METRICS_SHARD_COUNT];
+        LatencyHistogram m_batch_size;
+        LatencyHistogram m_queue_time_ns;
+        LatencyHistogram m_handle_time_ns;
+        std::atomic<int> m_queue_high_water;
+
+        /// 每个线程固定使用一个分片
+        inline Shard &local_shard()
+        {
+            static std::atomic<unsigned int> s_next_index(0);
+            static thread_local unsigned int s_index = s_next_index.fetch_add(1, std::memory_order_relaxed);
+            return m_shards[s_index % METRICS_SHARD_COUNT];
+        }
+
+    public:
+        inline void on_enqueue(const int count)
+        {
+            local_shard().m_enqueued.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+        }
+
+        inline void on_drop(const int count)
+        {
+            local_shard().m_dropped.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+        }
+
+        inline void on_expire(const int count)
+        {
+            local_shard().m_expired.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+        }
+
+        /// enqueue_ns为本批中最早入队的时间，为0时不统计排队时间
+        inline void on_dequeue(const int count, const int64_t enqueue_ns, const int64_t now_ns)
+        {
+            local_shard().m_dequeued.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+
+            if (enqueue_ns > 0 && now_ns > enqueue_ns)
+            {
+                m_queue_time_ns.record(static_cast<uint64_t>(now_ns - enqueue_ns));
+            }
+        }
+
+        inline void on_batch(const int count)
+        {
+            m_batch_size.record(static_cast<uint64_t>(count));
+        }
+
+        inline void on_handle(const int64_t cost_ns)
+        {
+            m_handle_time_ns.record(static_cast<uint64_t>(cost_ns > 0 ? cost_ns : 0));
+        }
+
+        inline void update_high_water(const int depth)
+        {
+            int cur = m_queue_high_water.load(std::memory_order_relaxed);
+            while (depth > cur && !m_queue_high_water.compare_exchange_weak(cur, depth, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        /// 汇总所有分片，不修改stats中的id、name及队列深度
+        void collect(ProcessorStats &stats) const
+        {
+            for (const auto &shard : m_shards)
+            {
+                stats.m_enqueued += shard.m_enqueued.load(std::memory_order_relaxed);
+                stats.m_dequeued += shard.m_dequeued.load(std::memory_order_relaxed);
+                stats.m_dropped += shard.m_dropped.load(std::memory_order_relaxed);
+                stats.m_expired += shard.m_expired.load(std::memory_order_relaxed);
+            }
+
+            m_batch_size.collect(stats.m_batch_size);
+            m_queue_time_ns.collect(stats.m_queue_time_ns);
+            m_handle_time_ns.collect(stats.m_handle_time_ns);
+
+            stats.m_queue_high_water = m_queue_high_water.load(std::memory_order_relaxed);
+        }
+
+        /// 清零，与热路径并发时个别计数可能落在清零之前
+        void reset()
+        {
+            for (auto &shard : m_shards)
+            {
+                shard.m_enqueued.store(0, std::memory_order_relaxed);
+                shard.m_dequeued.store(0, std::memory_order_relaxed);
+                shard.m_dropped.store(0, std::memory_order_relaxed);
+                shard.m_expired.store(0, std::memory_order_relaxed);
+            }
+
+            m_batch_size.reset();
+            m_queue_time_ns.reset();
+            m_handle_time_ns.reset();
+
+            m_queue_high_water.store(0, std::memory_order_relaxed);
+        }
+    };
+
+}
+
+#endif
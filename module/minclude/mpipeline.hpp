@@ -0,0 +1,254 @@
+#ifndef __M_PIPELINE_HPP_
+#define __M_PIPELINE_HPP_
+
+#include <vector>
+#include <list>
+#include <string>
+#include <chrono>
+#include <functional>
+
+#include "mprocessor.hpp"
+
+namespace m_module_space
+{
+
+    /// 流水线拓扑：登记各单元及其连接，校验无环后按拓扑序启动与停止
+    /// 连接在start()时才写入各单元；start()之前不要手动调用add_processor连接已登记的单元
+    class Pipeline
+    {
+    public:
+        Pipeline() : m_started(false), m_connected(false) {}
+
+        /// 析构时不等待排空，需要排空时先调用stop()
+        ~Pipeline() { stop(0); }
+
+    private:
+        Pipeline(const Pipeline &) = delete;
+
+        Pipeline &operator=(const Pipeline &) = delete;
+
+    private:
+        struct Stage
+        {
+            const void *m_key = nullptr;
+            int m_parallelism = 1;
+            std::function<int(int)> m_begin_thread;
+            std::function<int(int)> m_drain;
+        };
+
+        struct Edge
+        {
+            size_t m_from = 0;
+            size_t m_to = 0;
+            std::function<int()> m_connect;
+        };
+
+        std::vector<Stage> m_stages;
+        std::vector<Edge> m_edges;
+        std::vector<size_t> m_topo_order;
+        bool m_started;
+        bool m_connected; /// 连接只在第一次start()时写入
+
+    private:
+        int find_stage(const void *key) const
+        {
+            for (size_t i = 0; i < m_stages.size(); ++i)
+            {
+                if (m_stages[i].m_key == key)
+                {
+                    return static_cast<int>(i);
+                }
+            }
+
+            return PROCESSOR_FAIL;
+        }
+
+        int add_edge(const void *from, const void *to, std::function<int()> connect)
+        {
+            int from_index = find_stage(from);
+            int to_index = find_stage(to);
+
+            if (m_connected || from_index < 0 || to_index < 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            for (auto &edge : m_edges)
+            {
+                if (edge.m_from == static_cast<size_t>(from_index) && edge.m_to == static_cast<size_t>(to_index))
+                {
+                    return PROCESSOR_FAIL;
+                }
+            }
+
+            Edge edge;
+            edge.m_from = static_cast<size_t>(from_index);
+            edge.m_to = static_cast<size_t>(to_index);
+            edge.m_connect = std::move(connect);
+            m_edges.emplace_back(std::move(edge));
+            return PROCESSOR_SUCCESS;
+        }
+
+    public:
+        /// 登记单元，parallelism为start()时启动的线程数；返回单元序号
+        template<typename T>
+        int add_stage(Processor<T> *processor, const int parallelism = 1)
+        {
+            if (m_connected || processor == nullptr || parallelism <= 0 || find_stage(processor) >= 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            Stage stage;
+            stage.m_key = processor;
+            stage.m_parallelism = parallelism;
+            stage.m_begin_thread = [processor](int count) -> int { return processor->begin_thread(count); };
+            stage.m_drain = [processor](int time_out_ms) -> int { return processor->drain(time_out_ms, false); };
+
+            m_stages.emplace_back(std::move(stage));
+            return static_cast<int>(m_stages.size() - 1);
+        }
+
+        /// 连接任务类型相同的两个已登记单元
+        template<typename T>
+        int connect(Processor<T> *from, Processor<T> *to)
+        {
+            return add_edge(from, to, [from, to]() -> int { return from->add_processor(to); });
+        }
+
+        /// 连接任务类型不同的两个已登记单元，convert把上游任务转换为下游任务
+        template<typename T, typename U, typename F>
+        int connect(Processor<T> *from, Processor<U> *to, F convert)
+        {
+            return add_edge(from, to, [from, to, convert]() -> int { return from->add_processor(to, convert); });
+        }
+
+        /// 校验拓扑无环并计算拓扑序，有环返回PROCESSOR_FAIL
+        int validate()
+        {
+            std::vector<int> in_degree(m_stages.size(), 0);
+            for (auto &edge : m_edges)
+            {
+                ++in_degree[edge.m_to];
+            }
+
+            std::list<size_t> ready;
+            for (size_t i = 0; i < m_stages.size(); ++i)
+            {
+                if (in_degree[i] == 0)
+                {
+                    ready.push_back(i);
+                }
+            }
+
+            std::vector<size_t> topo_order;
+            while (!ready.empty())
+            {
+                size_t cur = ready.front();
+                ready.pop_front();
+                topo_order.push_back(cur);
+
+                for (auto &edge : m_edges)
+                {
+                    if (edge.m_from == cur && --in_degree[edge.m_to] == 0)
+                    {
+                        ready.push_back(edge.m_to);
+                    }
+                }
+            }
+
+            if (topo_order.size() != m_stages.size())
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            m_topo_order.swap(topo_order);
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 校验、连接，并从下游到上游依次启动线程
+        int start()
+        {
+            if (m_started || (!m_connected && validate() != PROCESSOR_SUCCESS))
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            if (!m_connected)
+            {
+                for (auto &edge : m_edges)
+                {
+                    if (edge.m_connect() != PROCESSOR_SUCCESS)
+                    {
+                        return PROCESSOR_FAIL;
+                    }
+                }
+
+                m_connected = true;
+            }
+
+            m_started = true;
+
+            for (auto itr = m_topo_order.rbegin(); itr != m_topo_order.rend(); ++itr)
+            {
+                Stage &stage = m_stages[*itr];
+                if (stage.m_begin_thread(stage.m_parallelism) <= 0)
+                {
+                    stop(0);
+                    return PROCESSOR_FAIL;
+                }
+            }
+
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 按拓扑序排空：每个单元先停止接收，等待队列中及正在处理的任务完成，再结束线程
+        /// 源头单元停止接收后外部投递返回PROCESSOR_STOPPED；drain_ms为所有单元共用的等待上限，小于0表示一直等待
+        /// 全部排空返回PROCESSOR_SUCCESS，超时的单元剩余任务被放弃并返回PROCESSOR_TIME_OUT
+        int stop(const int drain_ms = (-1))
+        {
+            if (!m_started)
+            {
+                return PROCESSOR_SUCCESS;
+            }
+
+            m_started = false;
+
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drain_ms);
+            int result = PROCESSOR_SUCCESS;
+
+            for (auto index : m_topo_order)
+            {
+                int remain_ms = (-1);
+                if (drain_ms >= 0)
+                {
+                    auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+                    remain_ms = remain > 0 ? static_cast<int>(remain) : 0;
+                }
+
+                if (m_stages[index].m_drain(remain_ms) != PROCESSOR_SUCCESS)
+                {
+                    result = PROCESSOR_TIME_OUT;
+                }
+            }
+
+            return result;
+        }
+
+        /// 是否已启动
+        inline bool is_started() const
+        {
+            return m_started;
+        }
+
+        /// 拓扑序，validate()或start()之后有效
+        inline const std::vector<size_t> &get_topo_order() const
+        {
+            return m_topo_order;
+        }
+    };
+
+}
+
+#endif
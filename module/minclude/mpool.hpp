@@ -0,0 +1,358 @@
+#ifndef __M_POOL_HPP_
+#define __M_POOL_HPP_
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+namespace m_module_space
+{
+
+    enum
+    {
+        POOL_MIN_BLOCK_SHIFT = 4,  /// 最小块16字节
+        POOL_CLASS_COUNT = 9,      /// 16、32、...、4096字节共9种尺寸，更大的请求直接走堆
+        POOL_CACHE_LIMIT = 256,    /// 每个线程每种尺寸最多缓存的空闲块
+        POOL_TRANSFER_COUNT = 64,  /// 线程缓存与公共仓库之间一次搬运的块数
+        POOL_LIST_CACHE_LIMIT = 1024 /// 每个线程每种元素类型最多保留的链表节点
+    };
+
+    /// 池的运行计数
+    struct PoolStats
+    {
+        uint64_t m_heap_blocks = 0;  /// 从堆上分配的块数，稳定运行后不再增长
+        uint64_t m_depot_blocks = 0; /// 公共仓库中的空闲块数
+    };
+
+    /// 定长块池：按2的幂分尺寸，每个线程有自己的空闲链表，
+    /// 线程缓存过多或线程退出时把空闲块归还公共仓库，供其他线程取用
+    /// 块只在release_cached()时还给堆
+    class BlockPool
+    {
+    public:
+        static BlockPool &instance()
+        {
+            static BlockPool s_pool;
+            return s_pool;
+        }
+
+    private:
+        BlockPool() : m_heap_blocks(0) {}
+
+        BlockPool(const BlockPool &) = delete;
+
+        BlockPool &operator=(const BlockPool &) = delete;
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock *m_next;
+        };
+
+        struct Depot
+        {
+            std::mutex m_lock;
+            FreeBlock *m_head = nullptr;
+            size_t m_count = 0;
+        };
+
+        /// 线程缓存，线程退出时归还全部空闲块
+        struct LocalCache
+        {
+            FreeBlock *m_head[POOL_CLASS_COUNT] = {};
+            size_t m_count[POOL_CLASS_COUNT] = {};
+
+            ~LocalCache()
+            {
+                for (int i = 0; i < POOL_CLASS_COUNT; ++i)
+                {
+                    BlockPool::instance().give_back(i, m_head[i], m_count[i]);
+                    m_head[i] = nullptr;
+                    m_count[i] = 0;
+                }
+            }
+        };
+
+        Depot m_depots[POOL_CLASS_COUNT];
+        std::atomic<uint64_t> m_heap_blocks;
+
+        static inline LocalCache &local_cache()
+        {
+            static thread_local LocalCache s_cache;
+            return s_cache;
+        }
+
+        static inline size_t class_bytes(const int index)
+        {
+            return static_cast<size_t>(1) << (index + POOL_MIN_BLOCK_SHIFT);
+        }
+
+        /// 尺寸序号，超过最大尺寸返回-1
+        static inline int class_of(const size_t bytes)
+        {
+            int index = 0;
+            while (index < POOL_CLASS_COUNT && class_bytes(index) < bytes)
+            {
+                ++index;
+            }
+
+            return index < POOL_CLASS_COUNT ? index : (-1);
+        }
+
+        /// 把一串空闲块放回公共仓库
+        void give_back(const int index, FreeBlock *p_head, const size_t count)
+        {
+            if (p_head == nullptr)
+            {
+                return;
+            }
+
+            FreeBlock *p_tail = p_head;
+            while (p_tail->m_next != nullptr)
+            {
+                p_tail = p_tail->m_next;
+            }
+
+            Depot &depot = m_depots[index];
+            std::lock_guard<std::mutex> auto_lock(depot.m_lock);
+            p_tail->m_next = depot.m_head;
+            depot.m_head = p_head;
+            depot.m_count += count;
+        }
+
+        /// 从公共仓库取至多POOL_TRANSFER_COUNT个块放入线程缓存
+        bool refill(const int index, LocalCache &cache)
+        {
+            Depot &depot = m_depots[index];
+            std::lock_guard<std::mutex> auto_lock(depot.m_lock);
+
+            if (depot.m_head == nullptr)
+            {
+                return false;
+            }
+
+            FreeBlock *p_head = depot.m_head;
+            FreeBlock *p_tail = p_head;
+            size_t count = 1;
+
+            while (count < POOL_TRANSFER_COUNT && p_tail->m_next != nullptr)
+            {
+                p_tail = p_tail->m_next;
+                ++count;
+            }
+
+            depot.m_head = p_tail->m_next;
+            depot.m_count -= count;
+
+            p_tail->m_next = cache.m_head[index];
+            cache.m_head[index] = p_head;
+            cache.m_count[index] += count;
+            return true;
+        }
+
+    public:
+        void *allocate(const size_t bytes)
+        {
+            const int index = class_of(bytes);
+            if (index < 0)
+            {
+                return ::operator new(bytes);
+            }
+
+            LocalCache &cache = local_cache();
+            if (cache.m_head[index] == nullptr && !refill(index, cache))
+            {
+                m_heap_blocks.fetch_add(1, std::memory_order_relaxed);
+                return ::operator new(class_bytes(index));
+            }
+
+            FreeBlock *p_block = cache.m_head[index];
+            cache.m_head[index] = p_block->m_next;
+            --cache.m_count[index];
+            return p_block;
+        }
+
+        void deallocate(void *p, const size_t bytes)
+        {
+            if (p == nullptr)
+            {
+                return;
+            }
+
+            const int index = class_of(bytes);
+            if (index < 0)
+            {
+                ::operator delete(p);
+                return;
+            }
+
+            LocalCache &cache = local_cache();
+            FreeBlock *p_block = static_cast<FreeBlock *>(p);
+            p_block->m_next = cache.m_head[index];
+            cache.m_head[index] = p_block;
+
+            /// 生产者与消费者不在同一线程时块会积在释放端，超过上限后成批归还
+            if (++cache.m_count[index] > POOL_CACHE_LIMIT)
+            {
+                FreeBlock *p_head = cache.m_head[index];
+                FreeBlock *p_tail = p_head;
+                for (int i = 1; i < POOL_TRANSFER_COUNT; ++i)
+                {
+                    p_tail = p_tail->m_next;
+                }
+
+                cache.m_head[index] = p_tail->m_next;
+                cache.m_count[index] -= POOL_TRANSFER_COUNT;
+                p_tail->m_next = nullptr;
+                give_back(index, p_head, POOL_TRANSFER_COUNT);
+            }
+        }
+
+        /// 把公共仓库中的空闲块还给堆，线程缓存中的块不受影响
+        void release_cached()
+        {
+            for (int i = 0; i < POOL_CLASS_COUNT; ++i)
+            {
+                FreeBlock *p_head = nullptr;
+                {
+                    std::lock_guard<std::mutex> auto_lock(m_depots[i].m_lock);
+                    p_head = m_depots[i].m_head;
+                    m_heap_blocks.fetch_sub(m_depots[i].m_count, std::memory_order_relaxed);
+                    m_depots[i].m_head = nullptr;
+                    m_depots[i].m_count = 0;
+                }
+
+                while (p_head != nullptr)
+                {
+                    FreeBlock *p_next = p_head->m_next;
+                    ::operator delete(p_head);
+                    p_head = p_next;
+                }
+            }
+        }
+
+        void get_stats(PoolStats &stats)
+        {
+            stats = PoolStats();
+            stats.m_heap_blocks = m_heap_blocks.load(std::memory_order_relaxed);
+
+            for (auto &depot : m_depots)
+            {
+                std::lock_guard<std::mutex> auto_lock(depot.m_lock);
+                stats.m_depot_blocks += depot.m_count;
+            }
+        }
+    };
+
+    /// 从BlockPool分配的标准分配器，无状态，所有实例可互相释放
+    template<typename U>
+    class PoolAllocator
+    {
+    public:
+        using value_type = U;
+
+        PoolAllocator() noexcept {}
+
+        template<typename V>
+        PoolAllocator(const PoolAllocator<V> &) noexcept {}
+
+        U *allocate(const size_t n)
+        {
+            /// 超过默认对齐的类型走堆
+            if (alignof(U) > alignof(std::max_align_t))
+            {
+                return std::allocator<U>().allocate(n);
+            }
+
+            return static_cast<U *>(BlockPool::instance().allocate(n * sizeof(U)));
+        }
+
+        void deallocate(U *p, const size_t n)
+        {
+            if (alignof(U) > alignof(std::max_align_t))
+            {
+                std::allocator<U>().deallocate(p, n);
+                return;
+            }
+
+            BlockPool::instance().deallocate(p, n * sizeof(U));
+        }
+    };
+
+    template<typename U, typename V>
+    inline bool operator==(const PoolAllocator<U> &, const PoolAllocator<V> &)
+    {
+        return true;
+    }
+
+    template<typename U, typename V>
+    inline bool operator!=(const PoolAllocator<U> &, const PoolAllocator<V> &)
+    {
+        return false;
+    }
+
+    /// 任务对象与引用计数在同一个池化块中，释放后块回到线程缓存
+    template<typename T, typename... Args>
+    static inline std::shared_ptr<T> make_pooled(Args &&... args)
+    {
+        return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+    }
+
+    /// 线程内复用std::list节点：recycle()留下的节点供append()取用，
+    /// 工作线程每轮处理后回收任务列表，稳定运行时不再分配节点
+    template<typename V>
+    class ListNodeCache
+    {
+    private:
+        static inline std::list<V> &spare()
+        {
+            static thread_local std::list<V> s_spare;
+            return s_spare;
+        }
+
+    public:
+        static inline void append(std::list<V> &list, V &&value)
+        {
+            std::list<V> &spare_list = spare();
+            if (spare_list.empty())
+            {
+                list.emplace_back(std::move(value));
+                return;
+            }
+
+            spare_list.front() = std::move(value);
+            list.splice(list.end(), spare_list, spare_list.begin());
+        }
+
+        static inline void append(std::list<V> &list, const V &value)
+        {
+            V copy(value);
+            append(list, std::move(copy));
+        }
+
+        /// 清空list，元素先复位以释放其持有的对象，超过上限的节点直接释放
+        static void recycle(std::list<V> &list)
+        {
+            std::list<V> &spare_list = spare();
+            if (spare_list.size() + list.size() > POOL_LIST_CACHE_LIMIT)
+            {
+                list.clear();
+                return;
+            }
+
+            for (auto &value : list)
+            {
+                value = V();
+            }
+
+            spare_list.splice(spare_list.end(), list);
+        }
+    };
+
+}
+
+#endif
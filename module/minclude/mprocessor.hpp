@@ -4,13 +4,24 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <atomic>
+#include <set>
+#include <map>
+#include <condition_variable>
+#include <cstdint>
 
 #include "msemphore.hpp"
 #include "mevent.hpp"
+#include "mqueue.hpp"
+#include "mmetrics.hpp"
+#include "mthread.hpp"
+#include "mpool.hpp"
+#include "mtrace.hpp"
 
 namespace m_module_space
 {
@@ -23,7 +34,17 @@ namespace m_module_space
     class ThreadWrapper
     {
     public:
-        ThreadWrapper() : m_sp_thread(nullptr), m_init_flag(0), m_quit_flag(0) {}
+        ThreadWrapper() :
+                m_sp_thread(nullptr),
+                m_init_flag(0),
+                m_quit_flag(0),
+                m_exit_flag(0),
+                m_retire_flag(0),
+                m_handle_count(0),
+                m_busy_ns(0)
+        {
+
+        }
 
         ~ThreadWrapper()
         {
@@ -46,6 +67,10 @@ namespace m_module_space
         std::shared_ptr<std::thread> m_sp_thread; /// C++11线程类
         volatile int m_init_flag; /// 在创建者与线程之间同步线程信息
         volatile int m_quit_flag; /// 线程退出标志
+        volatile int m_exit_flag; /// 线程函数已结束
+        volatile int m_retire_flag; /// 取到缩容信号后自行退出，由伸缩线程回收
+        std::atomic<uint64_t> m_handle_count; /// 已处理的任务批次数，仅由本线程写入
+        std::atomic<uint64_t> m_busy_ns; /// 处理及传递任务的累计耗时，开启计时或自动伸缩时由本线程写入
 
     public:
         /// 线程退出
@@ -59,6 +84,12 @@ namespace m_module_space
         {
             return m_quit_flag != 0;
         }
+
+        /// 判断线程函数是否已结束
+        inline bool is_thread_exit() const
+        {
+            return m_exit_flag != 0;
+        }
     };
 
 
@@ -70,12 +101,157 @@ namespace m_module_space
         PROCESSOR_SUCCESS = 0,
         PROCESSOR_TIME_OUT = 1,
         PROCESSOR_QUEUE_FULL = 2,
-        PROCESSOR_QUEUE_EMPTY = 3
+        PROCESSOR_QUEUE_EMPTY = 3,
+        PROCESSOR_STOPPED = 4 /// 单元已停止接收任务（正在排空或已排空）
+    };
+
+    /// 任务队列后端
+    enum
+    {
+        PROCESSOR_QUEUE_LIST = 0, /// std::list + 互斥锁
+        PROCESSOR_QUEUE_RING = 1  /// 无锁有界环形队列，不分配节点
+    };
+
+    /// 线程调度模式
+    enum
+    {
+        PROCESSOR_SCHEDULE_SHARED = 0, /// 所有线程从同一任务队列读取
+        PROCESSOR_SCHEDULE_STEAL = 1,  /// 每个线程拥有本地队列，外部投递轮流分到各线程，空闲时从其他线程窃取
+        PROCESSOR_SCHEDULE_PRIORITY = 2 /// 按优先级、截止时间取最紧急的任务，过期任务不处理
+    };
+
+    /// 工作窃取模式下拥有本地队列的线程数上限，超出的线程只读共享队列并参与窃取
+    enum
+    {
+        PROCESSOR_STEAL_MAX_WORKERS = 64
+    };
+
+    /// 任务优先级，数值越小越紧急，也可以使用其他整数
+    enum
+    {
+        PROCESSOR_PRIORITY_CRITICAL = 0,
+        PROCESSOR_PRIORITY_HIGH = 1,
+        PROCESSOR_PRIORITY_NORMAL = 2,
+        PROCESSOR_PRIORITY_LOW = 3
+    };
+
+    /// 任务队列满时的处理策略
+    enum
+    {
+        PROCESSOR_OVERFLOW_DROP_NEWEST = 0, /// 拒绝新任务，返回PROCESSOR_QUEUE_FULL
+        PROCESSOR_OVERFLOW_DROP_OLDEST = 1, /// 丢弃最旧的任务，为新任务腾出位置
+        PROCESSOR_OVERFLOW_BLOCK = 2,       /// 阻塞生产者直到有空位或超时
+        PROCESSOR_OVERFLOW_SPILL = 3        /// 写入无界暂存队列，有空位时按序回填
+    };
+
+    /// 空闲线程等待方式
+    enum
+    {
+        PROCESSOR_IDLE_POLL = 0, /// 每隔m_thread_timeout_ms醒来一次，在工作线程中调用handle_timeout
+        PROCESSOR_IDLE_PARK = 1  /// 休眠直到有任务，由独立定时线程调用handle_timeout
+    };
+
+    /// 线程数自动伸缩策略：连续m_up_periods个周期过载则扩容，连续m_down_periods个周期空闲则缩容一个线程
+    struct ProcessorAutoscalePolicy
+    {
+        int m_min_threads = 1;
+        int m_max_threads = 16;
+        int m_check_ms = 1000;            /// 检查周期
+        int m_up_queue_per_thread = 64;   /// 排队任务数超过线程数乘以该值视为过载
+        double m_up_utilization = 0.85;   /// 线程平均忙碌比例超过该值视为过载
+        double m_down_utilization = 0.30; /// 队列为空且忙碌比例低于该值视为空闲，须小于m_up_utilization
+        int m_up_periods = 2;
+        int m_down_periods = 10;
+    };
+
+    /// 不可变任务批次，fan_out时多个下游共享同一份
+    template<typename T>
+    using TaskBatch = std::vector<std::shared_ptr<T>, PoolAllocator<std::shared_ptr<T>>>;
+
+    template<typename T>
+    using SP_TASK_BATCH = std::shared_ptr<const TaskBatch<T>>;
+
+    /// 创建批次，批次对象、引用计数及元素数组都从池中分配
+    template<typename T, typename... Args>
+    static inline std::shared_ptr<TaskBatch<T>> make_task_batch(Args &&... args)
+    {
+        return make_pooled<TaskBatch<T>>(std::forward<Args>(args)...);
+    }
+
+    /// 任务队列中的一项：单个任务，或共享批次中尚未取出的部分
+    template<typename T>
+    struct TaskEntry
+    {
+        std::shared_ptr<T> m_task;
+        SP_TASK_BATCH<T> m_batch;
+        size_t m_offset = 0;
+        int64_t m_enqueue_ns = 0; /// 入队时间，未开启统计时为0
+        int m_priority = PROCESSOR_PRIORITY_NORMAL;
+        int64_t m_deadline_ns = 0; /// metrics_now_ns()时钟下的截止时间，0表示没有截止时间
+        bool m_classified = false; /// 已指定优先级，不再调用classify_task
+        uint64_t m_trace_id = 0; /// 采样跟踪号，0表示不跟踪
+        int64_t m_trace_ns = 0;  /// 跟踪时的投递时间
+
+        TaskEntry() {}
+
+        explicit TaskEntry(const std::shared_ptr<T> &sp_task) : m_task(sp_task) {}
+
+        explicit TaskEntry(const SP_TASK_BATCH<T> &sp_batch) : m_batch(sp_batch) {}
+
+        /// 剩余任务数
+        inline int size() const
+        {
+            if (m_batch != nullptr)
+            {
+                return static_cast<int>(m_batch->size() - m_offset);
+            }
+
+            return m_offset == 0 ? 1 : 0;
+        }
+
+        /// 取出至多max_count个任务追加到task，返回实际数量；p_enqueue_ns记录取出任务中最早的入队时间
+        /// trace为true表示工作线程取出任务去处理，登记采样跟踪号；丢弃、过期时取出不登记
+        int take(std::list<std::shared_ptr<T>> &task, const int max_count, int64_t *p_enqueue_ns = nullptr,
+                 const bool trace = false)
+        {
+            if (p_enqueue_ns != nullptr && m_enqueue_ns > 0 && max_count > 0 &&
+                (*p_enqueue_ns == 0 || m_enqueue_ns < *p_enqueue_ns))
+            {
+                *p_enqueue_ns = m_enqueue_ns;
+            }
+
+            if (trace && m_trace_id != 0 && max_count > 0 && size() > 0)
+            {
+                Tracer::on_take(m_trace_id, m_trace_ns);
+            }
+
+            if (m_batch == nullptr)
+            {
+                if (m_offset != 0 || max_count <= 0)
+                {
+                    return 0;
+                }
+
+                ListNodeCache<std::shared_ptr<T>>::append(task, std::move(m_task));
+                m_offset = 1;
+                return 1;
+            }
+
+            int count = 0;
+            for (; count < max_count && m_offset < m_batch->size(); ++count)
+            {
+                ListNodeCache<std::shared_ptr<T>>::append(task, (*m_batch)[m_offset++]);
+            }
+
+            return count;
+        }
     };
 
     template<typename T>
     class Processor
     {
+        template<typename> friend class Processor;
+
     public:
         Processor() {}
 
@@ -88,12 +264,83 @@ namespace m_module_space
 
     protected:
         /// 任务队列
-        std::list<std::shared_ptr<T>> m_task_list;
+        std::list<TaskEntry<T>, PoolAllocator<TaskEntry<T>>> m_task_list;
         std::mutex m_task_lock;
-        volatile int m_task_size = 0;
+        std::atomic<int> m_task_size{0}; /// 已预留的任务数，包含正在入队的任务
         Semphore m_task_semphore;
         volatile int m_task_max_count = 1024;
-        volatile int m_task_list_full_flag = 0;
+        std::atomic<int> m_task_list_full_flag{0};
+        std::atomic<int> m_inflight_count{0}; /// 工作线程已取出、尚未处理及传递完的任务数
+
+        /// 排空
+        std::atomic<int> m_accepting{1}; /// 为0时拒绝新任务
+        std::atomic<int> m_pushing{0}; /// 正在投递的调用数，停止接收后等其归零
+        std::atomic<int> m_upstream_count{0}; /// 通过add_processor连接到本单元的上游数
+        std::atomic<int> m_drained_upstreams{0}; /// 已排空的上游数，全部排空后本单元才开始排空
+
+        /// 环形队列后端
+        int m_queue_mode = PROCESSOR_QUEUE_LIST;
+        std::unique_ptr<RingQueue<TaskEntry<T>>> m_task_ring;
+        std::atomic<int> m_ring_leftover{0}; /// 环形队列模式下未取完的批次暂存在m_task_list头部
+
+        /// 工作窃取模式下每个线程的本地队列，线程退出后留给下一个线程复用
+        struct StealWorker
+        {
+            const Processor<T> *m_owner = nullptr;
+            std::deque<TaskEntry<T>, PoolAllocator<TaskEntry<T>>> m_tasks;
+            std::mutex m_lock;
+            bool m_active = false; /// 有线程在使用，由m_lock保护
+        };
+
+        int m_schedule_mode = PROCESSOR_SCHEDULE_SHARED;
+        /// 本地队列只追加不删除，单元销毁时才释放；窃取和投递时直接读m_steal_slots，只锁目标队列
+        std::vector<std::unique_ptr<StealWorker>> m_steal_workers;
+        std::atomic<StealWorker *> m_steal_slots[PROCESSOR_STEAL_MAX_WORKERS];
+        std::atomic<int> m_steal_slot_count{0};
+        std::atomic<unsigned int> m_steal_next{0}; /// 外部投递轮流写入的下一个本地队列
+        std::mutex m_steal_lock;                   /// 只在线程登记时使用
+
+        /// 优先级模式下的任务队列，按(优先级, 截止时间, 入队序号)排序，由m_task_lock保护
+        struct PriorityKey
+        {
+            int m_priority;
+            int64_t m_deadline_ns;
+            uint64_t m_seq;
+
+            bool operator<(const PriorityKey &other) const
+            {
+                if (m_priority != other.m_priority)
+                {
+                    return m_priority < other.m_priority;
+                }
+
+                /// 没有截止时间的任务排在同优先级有截止时间的任务之后
+                int64_t deadline = m_deadline_ns > 0 ? m_deadline_ns : INT64_MAX;
+                int64_t other_deadline = other.m_deadline_ns > 0 ? other.m_deadline_ns : INT64_MAX;
+                if (deadline != other_deadline)
+                {
+                    return deadline < other_deadline;
+                }
+
+                return m_seq < other.m_seq;
+            }
+        };
+
+        std::map<PriorityKey, TaskEntry<T>, std::less<PriorityKey>,
+                 PoolAllocator<std::pair<const PriorityKey, TaskEntry<T>>>> m_priority_tasks;
+        uint64_t m_priority_seq = 0;
+
+        /// 队列满处理策略
+        volatile int m_overflow_policy = PROCESSOR_OVERFLOW_DROP_NEWEST;
+        volatile int m_overflow_wait_ms = (-1); /// 阻塞策略的默认等待时间，小于0表示一直等待
+        std::mutex m_space_lock;
+        std::condition_variable m_space_cv;
+        std::atomic<int> m_space_waiters{0};
+
+        /// 溢出暂存队列
+        std::list<TaskEntry<T>, PoolAllocator<TaskEntry<T>>> m_spill_list;
+        std::mutex m_spill_lock;
+        std::atomic<int> m_spill_size{0};
 
         /// 线程队列
         std::list<SP_THREAD_WRAPPER> m_thread_list;
@@ -101,13 +348,51 @@ namespace m_module_space
         volatile int m_thread_max_count = 1024;
         volatile int m_thread_timeout_ms = 10;
 
+        /// 工作线程放置，由m_thread_lock保护，对之后创建的线程生效
+        ThreadPlacement m_thread_placement;
+        int m_thread_seq = 0; /// 已创建的工作线程序号，用于线程名与核心分配
+        std::atomic<int> m_placement_failures{0};
+
+        /// 空闲等待方式及PARK模式下的超时定时线程
+        int m_idle_mode = PROCESSOR_IDLE_POLL;
+        std::shared_ptr<std::thread> m_sp_timer_thread;
+        Event m_timer_quit_event;
+
+        /// 线程数自动伸缩，策略由m_thread_lock保护
+        volatile int m_autoscale_flag = 0;
+        ProcessorAutoscalePolicy m_autoscale_policy;
+        std::shared_ptr<std::thread> m_sp_autoscale_thread;
+        Event m_autoscale_quit_event;
+        uint64_t m_retired_busy_ns = 0; /// 已移除线程的忙碌时间，由m_thread_lock保护
+        uint64_t m_retired_handle_count = 0; /// 已移除线程处理的批次数，由m_thread_lock保护
+        std::atomic<int> m_retire_signals{0}; /// 已投递、尚未被工作线程取走的缩容信号数
+        int m_retiring_count = 0; /// 已投递缩容信号、尚未回收的线程数，由m_thread_lock保护
+
         /// 流水线队列
         std::list<Processor<T> *> m_next_processors;
+
+        using DrainDeadline = std::chrono::steady_clock::time_point;
+
+        /// 任务类型不同的下游，fan_out时转换后投递
+        struct NextSink
+        {
+            const void *m_target;
+            std::function<void(const SP_TASK_BATCH<T> &)> m_push;
+            std::function<int(const DrainDeadline *)> m_drain;
+        };
+
+        std::list<NextSink> m_next_sinks;
         int m_processor_id = 0;
         std::string m_processor_name;
 
         /// 获取任务batch
-        int m_batch_number = 1;
+        int m_batch_number = 1; /// 单次最多读取的任务数
+        int m_batch_min_number = 1; /// 凑够该数量即返回
+        int m_batch_linger_ms = 0; /// 不足m_batch_min_number时最多额外等待的时间
+
+        /// 运行统计，默认只保留计数；开启m_metrics_timing_flag后才在投递、读取及处理时读取时钟
+        ProcessorMetrics m_metrics;
+        volatile int m_metrics_timing_flag = 0;
 
     protected:
         /// 处理任务
@@ -134,6 +419,24 @@ namespace m_module_space
             return;
         }
 
+        /// 优先级模式下任务超过截止时间，未处理即被丢弃
+        virtual void report_task_expired(std::list<std::shared_ptr<T>> &/*tasks*/)
+        {
+            return;
+        }
+
+        /// 优先级模式下为未指定优先级的任务（push_task及上游fan_out投递的任务）确定优先级与截止时间
+        virtual void classify_task(const std::shared_ptr<T> &/*sp_task*/, int &/*priority*/, int64_t &/*deadline_ns*/)
+        {
+            return;
+        }
+
+        /// 任务被丢弃报警，包括DROP_OLDEST挤出的任务和fan_out时下游拒收的任务
+        virtual void report_task_dropped(std::list<std::shared_ptr<T>> &/*tasks*/)
+        {
+            return;
+        }
+
     public:
         /// 设置单元id
         inline void set_processor_id(int id)
@@ -154,314 +457,1944 @@ namespace m_module_space
         }
 
         /// 读取单元name
-        inline std::string get_processor_id()
+        inline std::string get_processor_name()
         {
             return m_processor_name;
         }
 
-    protected:
-        /// 任务流水线传递
-        virtual void fan_out(std::list<std::shared_ptr<T>> &task)
+        /// 选择任务队列后端，须在设置m_task_max_count之后、启动线程及投递任务之前调用
+        /// 环形队列容量为m_task_max_count向上取整的2的幂，实际上限仍为m_task_max_count
+        int set_queue_mode(const int mode)
         {
-            for (auto &cur_processor : this->m_next_processors)
+            if (mode != PROCESSOR_QUEUE_LIST && mode != PROCESSOR_QUEUE_RING)
             {
-                cur_processor->push_task(task);
+                return PROCESSOR_FAIL;
             }
-        }
 
-        /// 添加流水线单元
-        int add_processor(Processor<T> *processor)
-        {
-            if (processor == nullptr)
+            std::lock_guard<std::mutex> thread_lock(m_thread_lock);
+            std::lock_guard<std::mutex> task_lock(m_task_lock);
+
+            if (!m_thread_list.empty() || m_task_size != 0)
             {
                 return PROCESSOR_FAIL;
             }
 
-            for (auto &cur_processor : m_next_processors)
+            if (mode == PROCESSOR_QUEUE_RING)
             {
-                if (cur_processor == processor)
+                try
+                {
+                    m_task_ring.reset(new RingQueue<TaskEntry<T>>(static_cast<size_t>(m_task_max_count)));
+                }
+                catch (...)
                 {
                     return PROCESSOR_FAIL;
                 }
             }
+            else
+            {
+                m_task_ring.reset();
+            }
 
-            m_next_processors.push_back(processor);
+            m_queue_mode = mode;
             return PROCESSOR_SUCCESS;
         }
 
-    public:
-        /// 启动线程
-        virtual int begin_thread(const int count = 1)
+        /// 读取任务队列后端
+        inline int get_queue_mode() const
         {
-            if (count <= 0)
+            return m_queue_mode;
+        }
+
+        /// 选择线程调度模式，须在启动线程及投递任务之前调用
+        int set_schedule_mode(const int mode)
+        {
+            if (mode != PROCESSOR_SCHEDULE_SHARED && mode != PROCESSOR_SCHEDULE_STEAL &&
+                mode != PROCESSOR_SCHEDULE_PRIORITY)
             {
-                return 0;
+                return PROCESSOR_FAIL;
             }
 
-            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
-
-            int cur_count = static_cast<int>(m_thread_list.size());
-            int create_count = 0;
+            std::lock_guard<std::mutex> thread_lock(m_thread_lock);
 
-            for (; create_count < count;)
+            if (!m_thread_list.empty() || m_task_size != 0)
             {
-                if (cur_count >= m_thread_max_count)
-                {
-                    break;
-                }
-
-                try
-                {
-                    auto sp_thread_wrapper(std::make_shared<ThreadWrapper>());
+                return PROCESSOR_FAIL;
+            }
 
-                    sp_thread_wrapper->m_sp_thread = std::make_shared<std::thread>(
-                            [this](SP_THREAD_WRAPPER sp_thread_wrapper) -> void {
+            m_schedule_mode = mode;
+            return PROCESSOR_SUCCESS;
+        }
 
-                                if (sp_thread_wrapper == nullptr)
-                                {
-                                    return;
-                                }
+        /// 读取线程调度模式
+        inline int get_schedule_mode() const
+        {
+            return m_schedule_mode;
+        }
 
-                                /// 等待线程创建成功
-                                while (sp_thread_wrapper->m_init_flag == 0)
-                                {
-                                    std::this_thread::yield();
-                                }
+        /// 选择空闲线程等待方式，须在启动线程之前调用
+        int set_idle_mode(const int mode)
+        {
+            if (mode != PROCESSOR_IDLE_POLL && mode != PROCESSOR_IDLE_PARK)
+            {
+                return PROCESSOR_FAIL;
+            }
 
-                                std::list<std::shared_ptr<T>> tasks;
-                                int result = 0;
+            std::lock_guard<std::mutex> thread_lock(m_thread_lock);
 
-                                while (true)
-                                {
-                                    result = this->pop_task(tasks, this->m_thread_timeout_ms);
+            if (!m_thread_list.empty())
+            {
+                return PROCESSOR_FAIL;
+            }
 
-                                    if (sp_thread_wrapper->is_thread_quit())
-                                    {
-                                        break;
-                                    }
+            m_idle_mode = mode;
+            return PROCESSOR_SUCCESS;
+        }
 
-                                    if (result == PROCESSOR_SUCCESS)
-                                    {
-                                        this->handle_task(tasks);
-                                        this->fan_out(tasks);
-                                        tasks.clear();
-                                    }
-                                    else if (result == PROCESSOR_TIME_OUT)
-                                    {
-                                        this->handle_timeout();
-                                    }
-                                    else
-                                    {
-                                        ///异常
-                                    }
-                                }
+        /// 读取空闲线程等待方式
+        inline int get_idle_mode() const
+        {
+            return m_idle_mode;
+        }
 
-                                if (!sp_thread_wrapper->is_thread_quit())
-                                {
-                                    if (sp_thread_wrapper->m_sp_thread != nullptr)
-                                    {
-                                        sp_thread_wrapper->m_sp_thread->detach();
-                                    }
+        /// 设置队列满处理策略，wait_ms为阻塞策略下push_task未指定等待时间时的默认值
+        /// propagate为true时沿m_next_processors应用到整条流水线
+        int set_overflow_policy(const int policy, const int wait_ms = (-1), const bool propagate = false)
+        {
+            if (policy < PROCESSOR_OVERFLOW_DROP_NEWEST || policy > PROCESSOR_OVERFLOW_SPILL)
+            {
+                return PROCESSOR_FAIL;
+            }
 
-                                    this->remove_thread_wrapper(sp_thread_wrapper);
-                                }
+            std::set<Processor<T> *> visited;
+            std::list<Processor<T> *> pending(1, this);
 
-                            }, sp_thread_wrapper);
+            while (!pending.empty())
+            {
+                Processor<T> *cur_processor = pending.front();
+                pending.pop_front();
 
-                    sp_thread_wrapper->m_init_flag = 1024;
-                    std::this_thread::yield();
+                if (!visited.insert(cur_processor).second)
+                {
+                    continue;
+                }
 
-                    m_thread_list.emplace_back(sp_thread_wrapper);
+                cur_processor->m_overflow_policy = policy;
+                cur_processor->m_overflow_wait_ms = wait_ms;
 
-                    ++cur_count;
-                    ++create_count;
-                }
-                catch (...)
+                if (propagate)
                 {
-                    return create_count;
+                    pending.insert(pending.end(), cur_processor->m_next_processors.begin(),
+                                   cur_processor->m_next_processors.end());
                 }
             }
 
-            return create_count;
+            return PROCESSOR_SUCCESS;
         }
 
-    public:
-        /// 删除线程
-        void remove_thread_wrapper(const SP_THREAD_WRAPPER &sp_thread_wrapper)
+        /// 读取队列满处理策略
+        inline int get_overflow_policy() const
         {
-            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+            return m_overflow_policy;
+        }
 
-            for (auto itr = m_thread_list.begin(); itr != m_thread_list.end(); ++itr)
+        /// 暂存队列中的任务数
+        inline int get_spill_size() const
+        {
+            return m_spill_size;
+        }
+
+        /// 设置批量读取策略：单次最多读取max_batch个任务；
+        /// 不足min_batch个时最多再等待linger_ms凑批，超时则返回已读到的任务
+        int set_batch_policy(const int max_batch, const int linger_ms = 0, const int min_batch = 1)
+        {
+            if (max_batch <= 0 || linger_ms < 0 || min_batch <= 0 || min_batch > max_batch)
             {
-                if ((*itr) == sp_thread_wrapper)
-                {
-                    m_thread_list.erase(itr);
-                    return;
-                }
+                return PROCESSOR_FAIL;
             }
+
+            m_batch_number = max_batch;
+            m_batch_linger_ms = linger_ms;
+            m_batch_min_number = min_batch;
+            return PROCESSOR_SUCCESS;
         }
 
-        /// 暂停一个线程
-        void end_one_thread(SP_THREAD_WRAPPER &sp_target, bool sync = true)
+        /// 开关排队时间与handle_task耗时统计，默认关闭：每次投递与每批读取、处理各多读一到三次时钟
+        inline void set_metrics_timing(const bool enable)
         {
-            if (sp_target != nullptr && sp_target->m_sp_thread != nullptr && sp_target->m_sp_thread->joinable())
+            m_metrics_timing_flag = enable ? 1 : 0;
+        }
+
+        /// 读取本单元的统计快照
+        virtual void get_stats(ProcessorStats &stats)
+        {
+            stats = ProcessorStats();
+            stats.m_processor_id = m_processor_id;
+            stats.m_processor_name = m_processor_name;
+            stats.m_queue_depth = m_task_size;
+            stats.m_spill_size = m_spill_size;
+            m_metrics.collect(stats);
+        }
+
+        /// 沿m_next_processors读取整条流水线的统计快照，每个单元一项
+        void get_pipeline_stats(std::list<ProcessorStats> &stats_list)
+        {
+            std::set<Processor<T> *> visited;
+            std::list<Processor<T> *> pending(1, this);
+
+            while (!pending.empty())
             {
-                sp_target->set_quit_flag();
-                std::this_thread::yield();
+                Processor<T> *cur_processor = pending.front();
+                pending.pop_front();
 
-                if (sync)
-                {
-                    sp_target->m_sp_thread->join();
-                }
-                else
+                if (!visited.insert(cur_processor).second)
                 {
-                    sp_target->m_sp_thread->detach();
+                    continue;
                 }
 
-                sp_target->m_sp_thread.reset();
+                stats_list.emplace_back();
+                cur_processor->get_stats(stats_list.back());
+
+                pending.insert(pending.end(), cur_processor->m_next_processors.begin(),
+                               cur_processor->m_next_processors.end());
             }
         }
 
-        /// 暂停所有线程
-        void end_all_threads(bool sync = true)
+        /// 清零统计
+        void reset_stats()
         {
-            std::unique_lock<std::mutex> auto_lock(m_thread_lock);
+            m_metrics.reset();
+        }
 
-            if (m_thread_list.empty())
+    protected:
+        /// 任务流水线传递，所有下游共享同一个不可变批次，每个下游只增加一次引用计数
+        virtual void fan_out(std::list<std::shared_ptr<T>> &task)
+        {
+            if (task.empty() || (this->m_next_processors.empty() && this->m_next_sinks.empty()))
             {
                 return;
             }
 
-            auto temp_thread_list(std::move(m_thread_list)); ///取出所有线程
-            auto_lock.unlock(); /// 手动解锁，防止join()时死锁
+            SP_TASK_BATCH<T> sp_batch(make_task_batch<T>(task.begin(), task.end()));
 
-            /// 停止这些线程
-            for (auto &sp_target : temp_thread_list)
+            for (auto &cur_processor : this->m_next_processors)
             {
-                end_one_thread(sp_target, sync);
+                if (cur_processor->push_batch(sp_batch) != PROCESSOR_SUCCESS)
+                {
+                    cur_processor->report_task_dropped(task);
+                }
+            }
+
+            for (auto &cur_sink : this->m_next_sinks)
+            {
+                cur_sink.m_push(sp_batch);
+            }
+        }
+
+        /// 是否已连接到target
+        bool has_next(const void *target) const
+        {
+            for (auto &cur_processor : m_next_processors)
+            {
+                if (cur_processor == target)
+                {
+                    return true;
+                }
+            }
+
+            for (auto &cur_sink : m_next_sinks)
+            {
+                if (cur_sink.m_target == target)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    public:
+        /// 添加流水线单元
+        int add_processor(Processor<T> *processor)
+        {
+            if (processor == nullptr || has_next(processor))
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            m_next_processors.push_back(processor);
+            ++processor->m_upstream_count;
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 添加任务类型不同的流水线单元，convert把本单元的任务转换为下游任务，返回空指针的任务不传递
+        /// 每批只转换一次并整批投递；set_overflow_policy及get_pipeline_stats不沿这类连接传播
+        template<typename U, typename F>
+        int add_processor(Processor<U> *processor, F convert)
+        {
+            if (processor == nullptr || has_next(processor))
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            NextSink sink;
+            sink.m_target = processor;
+            sink.m_push = [processor, convert](const SP_TASK_BATCH<T> &sp_batch) -> void {
+                auto sp_next_batch(make_task_batch<U>());
+                sp_next_batch->reserve(sp_batch->size());
+
+                for (auto &sp_task : *sp_batch)
+                {
+                    std::shared_ptr<U> sp_next_task(convert(sp_task));
+                    if (sp_next_task != nullptr)
+                    {
+                        sp_next_batch->emplace_back(std::move(sp_next_task));
+                    }
+                }
+
+                if (sp_next_batch->empty())
+                {
+                    return;
+                }
+
+                SP_TASK_BATCH<U> sp_const_batch(sp_next_batch);
+                if (processor->push_batch(sp_const_batch) != PROCESSOR_SUCCESS)
+                {
+                    std::list<std::shared_ptr<U>> dropped(sp_const_batch->begin(), sp_const_batch->end());
+                    processor->report_task_dropped(dropped);
+                }
+            };
+            sink.m_drain = [processor](const DrainDeadline *p_deadline) -> int {
+                return processor->upstream_drained(p_deadline);
+            };
+
+            m_next_sinks.emplace_back(std::move(sink));
+            ++processor->m_upstream_count;
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 队列、暂存队列均为空，没有正在投递及正在处理的任务
+        virtual bool is_idle() const
+        {
+            return m_task_size.load() == 0 && m_spill_size.load() == 0 && m_inflight_count.load() == 0 &&
+                   m_pushing.load() == 0;
+        }
+
+        /// 等待已投递的任务全部处理完，time_out_ms小于0表示一直等待；调用者须保证期间没有新任务投递，或先调用stop_intake()
+        bool wait_idle(const int time_out_ms = (-1))
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(time_out_ms);
+
+            while (!is_idle())
+            {
+                if (time_out_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+                {
+                    return false;
+                }
+
+                thread_sleep_ms(1);
+            }
+
+            return true;
+        }
+
+        /// 停止接收新任务，之后的投递返回PROCESSOR_STOPPED
+        virtual void stop_intake()
+        {
+            m_accepting.store(0);
+        }
+
+        /// 恢复接收任务，begin_thread时自动调用
+        virtual void resume_intake()
+        {
+            m_drained_upstreams.store(0);
+            m_accepting.store(1);
+        }
+
+        /// 是否接收新任务
+        inline bool is_accepting() const
+        {
+            return m_accepting.load() != 0;
+        }
+
+        /// 排空：停止接收，处理完队列中及正在处理的任务后结束线程；time_out_ms小于0表示一直等待，
+        /// 超时则放弃剩余任务并返回PROCESSOR_TIME_OUT
+        /// propagate为true时沿m_next_processors及不同类型的下游传递，下游在其所有上游都排空后才开始排空
+        int drain(const int time_out_ms = (-1), const bool propagate = true)
+        {
+            DrainDeadline deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(time_out_ms));
+            return drain_until(time_out_ms < 0 ? nullptr : &deadline, propagate);
+        }
+
+    private:
+        int drain_until(const DrainDeadline *p_deadline, const bool propagate)
+        {
+            stop_intake();
+
+            int remain_ms = (-1);
+            if (p_deadline != nullptr)
+            {
+                auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        *p_deadline - std::chrono::steady_clock::now()).count();
+                remain_ms = remain > 0 ? static_cast<int>(remain) : 0;
+            }
+
+            int result = wait_idle(remain_ms) ? PROCESSOR_SUCCESS : PROCESSOR_TIME_OUT;
+            end_all_threads();
+
+            if (!propagate)
+            {
+                return result;
+            }
+
+            for (auto &cur_processor : m_next_processors)
+            {
+                if (cur_processor->upstream_drained(p_deadline) != PROCESSOR_SUCCESS)
+                {
+                    result = PROCESSOR_TIME_OUT;
+                }
+            }
+
+            for (auto &cur_sink : m_next_sinks)
+            {
+                if (cur_sink.m_drain(p_deadline) != PROCESSOR_SUCCESS)
+                {
+                    result = PROCESSOR_TIME_OUT;
+                }
+            }
+
+            return result;
+        }
+
+        /// 一个上游已排空，最后一个上游排空时排空本单元
+        int upstream_drained(const DrainDeadline *p_deadline)
+        {
+            if (++m_drained_upstreams < m_upstream_count.load())
+            {
+                return PROCESSOR_SUCCESS;
+            }
+
+            return drain_until(p_deadline, true);
+        }
+
+    public:
+        /// 启动线程
+        virtual int begin_thread(const int count = 1)
+        {
+            if (count <= 0)
+            {
+                return 0;
+            }
+
+            resume_intake();
+
+            if (!m_processor_name.empty())
+            {
+                Tracer::instance().set_processor_name(m_processor_id, m_processor_name);
+            }
+
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            int create_count = create_threads(count);
+
+            if (create_count > 0 && m_idle_mode == PROCESSOR_IDLE_PARK)
+            {
+                start_idle_timer();
+            }
+
+            if (create_count > 0 && m_autoscale_flag != 0)
+            {
+                start_autoscaler();
+            }
+
+            return create_count;
+        }
+
+        /// 设置工作线程的核心集合、NUMA节点、调度策略与命名，对之后创建的线程生效
+        int set_thread_placement(const ThreadPlacement &placement)
+        {
+            if (!check_thread_placement(placement))
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+            m_thread_placement = placement;
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 线程放置未能完全生效（如权限不足）的线程数
+        inline int get_placement_failures() const
+        {
+            return m_placement_failures.load();
+        }
+
+    private:
+        /// 线程名前缀，取单元名，未设置时为p加单元id
+        std::string thread_name_prefix() const
+        {
+            std::string prefix(m_processor_name.empty() ? "p" + std::to_string(m_processor_id) : m_processor_name);
+
+            /// 线程名最长15个字节，为序号留出位置
+            if (prefix.size() > 10)
+            {
+                prefix.resize(10);
+            }
+
+            return prefix + "#";
+        }
+
+        /// 创建count个工作线程，调用者持有m_thread_lock
+        int create_threads(const int count)
+        {
+            int cur_count = static_cast<int>(m_thread_list.size());
+            int create_count = 0;
+
+            for (; create_count < count;)
+            {
+                if (cur_count >= m_thread_max_count)
+                {
+                    break;
+                }
+
+                try
+                {
+                    auto sp_thread_wrapper(std::make_shared<ThreadWrapper>());
+
+                    const ThreadPlacement placement(m_thread_placement);
+                    const int thread_index = m_thread_seq;
+
+                    sp_thread_wrapper->m_sp_thread = std::make_shared<std::thread>(
+                            [this, placement, thread_index](SP_THREAD_WRAPPER sp_thread_wrapper) -> void {
+
+                                if (sp_thread_wrapper == nullptr)
+                                {
+                                    return;
+                                }
+
+                                /// 等待线程创建成功
+                                while (sp_thread_wrapper->m_init_flag == 0)
+                                {
+                                    std::this_thread::yield();
+                                }
+
+                                if (placement.m_set_name)
+                                {
+                                    set_current_thread_name(this->thread_name_prefix() + std::to_string(thread_index));
+                                }
+
+                                if (!apply_thread_placement(placement, thread_index))
+                                {
+                                    ++this->m_placement_failures;
+                                }
+
+                                Tracer::mark_worker_thread();
+
+                                if (this->m_schedule_mode == PROCESSOR_SCHEDULE_STEAL)
+                                {
+                                    this->attach_steal_worker();
+                                }
+
+                                this->run_worker(sp_thread_wrapper);
+
+                                if (this->m_schedule_mode == PROCESSOR_SCHEDULE_STEAL)
+                                {
+                                    this->detach_steal_worker();
+                                }
+
+                                if (!sp_thread_wrapper->is_thread_quit())
+                                {
+                                    if (sp_thread_wrapper->m_sp_thread != nullptr)
+                                    {
+                                        sp_thread_wrapper->m_sp_thread->detach();
+                                    }
+
+                                    this->remove_thread_wrapper(sp_thread_wrapper);
+                                }
+
+                                sp_thread_wrapper->m_exit_flag = 1;
+
+                            }, sp_thread_wrapper);
+
+                    sp_thread_wrapper->m_init_flag = 1024;
+                    std::this_thread::yield();
+
+                    m_thread_list.emplace_back(sp_thread_wrapper);
+
+                    ++m_thread_seq;
+                    ++cur_count;
+                    ++create_count;
+                }
+                catch (...)
+                {
+                    break;
+                }
+            }
+
+            return create_count;
+        }
+
+    protected:
+        /// 工作线程主循环，子类可替换取任务及处理的方式，须在is_thread_quit()后返回
+        virtual void run_worker(const SP_THREAD_WRAPPER &sp_thread_wrapper)
+        {
+            std::list<std::shared_ptr<T>> tasks;
+            int result = 0;
+
+            const int wait_ms = (m_idle_mode == PROCESSOR_IDLE_PARK) ? (-1) : m_thread_timeout_ms;
+
+            while (true)
+            {
+                result = pop_tasks(tasks, wait_ms, nullptr, sp_thread_wrapper.get());
+
+                /// 已取出的任务处理完再退出，缩容时不丢任务
+                if (sp_thread_wrapper->is_thread_quit() && result != PROCESSOR_SUCCESS)
+                {
+                    break;
+                }
+
+                if (result == PROCESSOR_SUCCESS)
+                {
+                    sp_thread_wrapper->m_handle_count.fetch_add(1, std::memory_order_relaxed);
+
+                    /// 本批有采样任务时，处理期间的投递继承其跟踪号；未开启跟踪时只读一次标志
+                    const bool traced = Tracer::instance().is_enabled() &&
+                                        Tracer::instance().begin_batch(m_processor_id);
+
+                    if (m_metrics_timing_flag != 0 || m_autoscale_flag != 0 || traced)
+                    {
+                        int64_t begin_ns = metrics_now_ns();
+                        handle_task(tasks);
+                        int64_t handle_ns = metrics_now_ns();
+                        fan_out(tasks);
+                        int64_t end_ns = metrics_now_ns();
+
+                        if (m_metrics_timing_flag != 0 || m_autoscale_flag != 0)
+                        {
+                            m_metrics.on_handle(handle_ns - begin_ns);
+                            sp_thread_wrapper->m_busy_ns.fetch_add(static_cast<uint64_t>(end_ns - begin_ns),
+                                                                   std::memory_order_relaxed);
+                        }
+
+                        if (traced)
+                        {
+                            Tracer::instance().end_batch(m_processor_id, begin_ns, handle_ns, end_ns);
+                        }
+                    }
+                    else
+                    {
+                        handle_task(tasks);
+                        fan_out(tasks);
+                    }
+
+                    m_inflight_count -= static_cast<int>(tasks.size());
+                    ListNodeCache<std::shared_ptr<T>>::recycle(tasks);
+                }
+                else if (result == PROCESSOR_TIME_OUT)
+                {
+                    handle_timeout();
+                }
+                else
+                {
+                    ///异常
+                }
+
+                if (sp_thread_wrapper->is_thread_quit())
+                {
+                    break;
+                }
+            }
+        }
+
+        /// 唤醒所有空闲等待的线程
+        virtual void wake_idle_threads()
+        {
+            m_task_semphore.interrupt();
+        }
+
+        /// 投递一个缩容信号：与任务共用信号量，只唤醒一个等待的线程，取到的线程处理完手中任务后退出
+        virtual void retire_one_thread()
+        {
+            ++m_retire_signals;
+            m_task_semphore.signal(1);
+        }
+
+    private:
+        /// 取走一个缩容信号，信号数与任务不对应，取到的信号只要还有缩容信号就当作缩容信号
+        inline bool take_retire_signal()
+        {
+            int cur = m_retire_signals.load(std::memory_order_relaxed);
+            while (cur > 0)
+            {
+                if (m_retire_signals.compare_exchange_weak(cur, cur - 1))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// 线程全部停止后收回未被取走的缩容信号
+        void clear_retire_signals()
+        {
+            const int left = m_retire_signals.exchange(0);
+            if (left > 0)
+            {
+                m_task_semphore.unsignal(left);
+            }
+
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+            m_retiring_count = 0;
+        }
+
+        /// PARK模式下启动定时线程，一个周期内没有线程处理任务则调用handle_timeout，调用者持有m_thread_lock
+        void start_idle_timer()
+        {
+            if (m_sp_timer_thread != nullptr || m_thread_timeout_ms <= 0)
+            {
+                return;
+            }
+
+            m_timer_quit_event.reset();
+
+            try
+            {
+                m_sp_timer_thread = std::make_shared<std::thread>([this]() -> void {
+                    set_current_thread_name(this->thread_name_prefix() + "timer");
+                    uint64_t last_count = this->handled_count();
+
+                    while (this->m_timer_quit_event.wait(this->m_thread_timeout_ms) == EVENT_TIME_OUT)
+                    {
+                        uint64_t cur_count = this->handled_count();
+                        if (cur_count == last_count)
+                        {
+                            this->handle_timeout();
+                        }
+
+                        last_count = cur_count;
+                    }
+                });
+            }
+            catch (...)
+            {
+                m_sp_timer_thread.reset();
+            }
+        }
+
+        void stop_idle_timer()
+        {
+            std::shared_ptr<std::thread> sp_timer_thread;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+                sp_timer_thread.swap(m_sp_timer_thread);
+            }
+
+            if (sp_timer_thread != nullptr && sp_timer_thread->joinable())
+            {
+                m_timer_quit_event.set();
+                sp_timer_thread->join();
+            }
+        }
+
+        /// 所有线程（含已移除线程）已处理的任务批次数之和
+        uint64_t handled_count()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            uint64_t count = m_retired_handle_count;
+            for (auto &sp_thread_wrapper : m_thread_list)
+            {
+                count += sp_thread_wrapper->m_handle_count.load(std::memory_order_relaxed);
+            }
+
+            return count;
+        }
+
+        /// 启动伸缩线程，调用者持有m_thread_lock
+        void start_autoscaler()
+        {
+            if (m_sp_autoscale_thread != nullptr)
+            {
+                return;
+            }
+
+            m_autoscale_quit_event.reset();
+
+            try
+            {
+                m_sp_autoscale_thread = std::make_shared<std::thread>([this]() -> void {
+                    set_current_thread_name(this->thread_name_prefix() + "scale");
+                    int up_streak = 0;
+                    int down_streak = 0;
+                    uint64_t last_busy_ns = this->busy_ns();
+                    int64_t last_ns = metrics_now_ns();
+
+                    while (true)
+                    {
+                        int check_ms = 0;
+                        {
+                            std::lock_guard<std::mutex> auto_lock(this->m_thread_lock);
+                            check_ms = this->m_autoscale_policy.m_check_ms;
+                        }
+
+                        if (this->m_autoscale_quit_event.wait(check_ms) != EVENT_TIME_OUT)
+                        {
+                            break;
+                        }
+
+                        uint64_t cur_busy_ns = this->busy_ns();
+                        int64_t cur_ns = metrics_now_ns();
+                        this->autoscale_once(cur_busy_ns - last_busy_ns, cur_ns - last_ns, up_streak, down_streak);
+
+                        /// 回收退出线程时其忙碌时间计入m_retired_busy_ns，重新取基准
+                        last_busy_ns = this->busy_ns();
+                        last_ns = cur_ns;
+                    }
+                });
+            }
+            catch (...)
+            {
+                m_sp_autoscale_thread.reset();
+            }
+        }
+
+        void stop_autoscaler()
+        {
+            std::shared_ptr<std::thread> sp_autoscale_thread;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+                sp_autoscale_thread.swap(m_sp_autoscale_thread);
+            }
+
+            if (sp_autoscale_thread != nullptr && sp_autoscale_thread->joinable())
+            {
+                m_autoscale_quit_event.set();
+                sp_autoscale_thread->join();
+            }
+        }
+
+        /// 所有线程（含已缩容线程）的累计忙碌时间
+        uint64_t busy_ns()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            uint64_t total_ns = m_retired_busy_ns;
+            for (auto &sp_thread_wrapper : m_thread_list)
+            {
+                total_ns += sp_thread_wrapper->m_busy_ns.load(std::memory_order_relaxed);
+            }
+
+            return total_ns;
+        }
+
+        /// 移除线程前把其计数并入m_retired_*，调用者持有m_thread_lock
+        void fold_thread_counts(const SP_THREAD_WRAPPER &sp_thread_wrapper)
+        {
+            m_retired_handle_count += sp_thread_wrapper->m_handle_count.load(std::memory_order_relaxed);
+            m_retired_busy_ns += sp_thread_wrapper->m_busy_ns.load(std::memory_order_relaxed);
+        }
+
+        /// 回收取到缩容信号后已经退出的线程
+        void reap_retired_threads()
+        {
+            std::list<SP_THREAD_WRAPPER> exited;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+                for (auto itr = m_thread_list.begin(); itr != m_thread_list.end();)
+                {
+                    if ((*itr)->m_retire_flag != 0 && (*itr)->is_thread_exit())
+                    {
+                        fold_thread_counts(*itr);
+                        exited.splice(exited.end(), m_thread_list, itr++);
+                        --m_retiring_count;
+                    }
+                    else
+                    {
+                        ++itr;
+                    }
+                }
+            }
+
+            for (auto &sp_target : exited)
+            {
+                if (sp_target->m_sp_thread != nullptr && sp_target->m_sp_thread->joinable())
+                {
+                    sp_target->m_sp_thread->join();
+                }
+
+                sp_target->m_sp_thread.reset();
+            }
+        }
+
+        /// 根据一个周期内的队列深度与忙碌比例扩容或缩容
+        void autoscale_once(const uint64_t busy_delta_ns, const int64_t period_ns, int &up_streak, int &down_streak)
+        {
+            reap_retired_threads();
+
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            const ProcessorAutoscalePolicy policy = m_autoscale_policy;
+
+            /// 已投递缩容信号、尚未回收的线程不计入线程数
+            const int thread_count = static_cast<int>(m_thread_list.size()) - m_retiring_count;
+
+            if (thread_count < policy.m_min_threads)
+            {
+                create_threads(policy.m_min_threads - thread_count);
+                up_streak = down_streak = 0;
+                return;
+            }
+
+            const int depth = m_task_size.load() + m_spill_size.load();
+            double utilization = 0.0;
+            if (thread_count > 0 && period_ns > 0)
+            {
+                utilization = static_cast<double>(busy_delta_ns) / (static_cast<double>(period_ns) * thread_count);
+            }
+
+            if (depth > thread_count * policy.m_up_queue_per_thread || utilization >= policy.m_up_utilization)
+            {
+                ++up_streak;
+                down_streak = 0;
+            }
+            else if (depth == 0 && utilization <= policy.m_down_utilization)
+            {
+                ++down_streak;
+                up_streak = 0;
+            }
+            else
+            {
+                up_streak = down_streak = 0;
+            }
+
+            if (up_streak >= policy.m_up_periods && thread_count < policy.m_max_threads)
+            {
+                /// 每次最多扩容一半，应对成倍变化的流量
+                int step = thread_count / 2 > 1 ? thread_count / 2 : 1;
+                if (step > policy.m_max_threads - thread_count)
+                {
+                    step = policy.m_max_threads - thread_count;
+                }
+
+                create_threads(step);
+                up_streak = 0;
+            }
+            else if (down_streak >= policy.m_down_periods && thread_count > policy.m_min_threads)
+            {
+                /// 不指定退出的线程，只唤醒一个空闲线程；下个周期回收
+                retire_one_thread();
+                ++m_retiring_count;
+                down_streak = 0;
+            }
+        }
+
+    public:
+        /// 开启线程数自动伸缩，线程已启动时立即生效，否则在begin_thread时生效
+        int set_autoscale_policy(const ProcessorAutoscalePolicy &policy)
+        {
+            if (policy.m_min_threads <= 0 || policy.m_max_threads < policy.m_min_threads ||
+                policy.m_max_threads > m_thread_max_count || policy.m_check_ms <= 0 ||
+                policy.m_up_queue_per_thread <= 0 || policy.m_up_periods <= 0 || policy.m_down_periods <= 0 ||
+                policy.m_down_utilization < 0.0 || policy.m_down_utilization >= policy.m_up_utilization)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            m_autoscale_policy = policy;
+            m_autoscale_flag = 1;
+
+            if (!m_thread_list.empty())
+            {
+                start_autoscaler();
+            }
+
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 关闭自动伸缩，保留当前线程数
+        void disable_autoscale()
+        {
+            m_autoscale_flag = 0;
+            stop_autoscaler();
+        }
+
+        /// 当前工作线程数
+        int get_thread_count()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+            return static_cast<int>(m_thread_list.size());
+        }
+
+    public:
+        /// 删除线程
+        void remove_thread_wrapper(const SP_THREAD_WRAPPER &sp_thread_wrapper)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_thread_lock);
+
+            for (auto itr = m_thread_list.begin(); itr != m_thread_list.end(); ++itr)
+            {
+                if ((*itr) == sp_thread_wrapper)
+                {
+                    fold_thread_counts(sp_thread_wrapper);
+                    m_thread_list.erase(itr);
+                    return;
+                }
+            }
+        }
+
+        /// 暂停一个线程
+        void end_one_thread(SP_THREAD_WRAPPER &sp_target, bool sync = true)
+        {
+            if (sp_target != nullptr && sp_target->m_sp_thread != nullptr && sp_target->m_sp_thread->joinable())
+            {
+                sp_target->set_quit_flag();
+                wake_idle_threads();
+                std::this_thread::yield();
+
+                if (sync)
+                {
+                    /// 线程可能在唤醒之后才进入等待，重复唤醒直到其退出循环
+                    while (!sp_target->is_thread_exit())
+                    {
+                        wake_idle_threads();
+                        thread_sleep_ms(1);
+                    }
+
+                    sp_target->m_sp_thread->join();
+                }
+                else
+                {
+                    sp_target->m_sp_thread->detach();
+                }
+
+                sp_target->m_sp_thread.reset();
+            }
+        }
+
+        /// 暂停所有线程
+        virtual void end_all_threads(bool sync = true)
+        {
+            stop_autoscaler();
+            stop_idle_timer();
+
+            std::unique_lock<std::mutex> auto_lock(m_thread_lock);
+
+            if (m_thread_list.empty())
+            {
+                return;
+            }
+
+            auto temp_thread_list(std::move(m_thread_list)); ///取出所有线程
+            auto_lock.unlock(); /// 手动解锁，防止join()时死锁
+
+            /// 先给所有线程设置退出标志，逐个等待时的唤醒不会白白叫醒还要继续等待的线程
+            for (auto &sp_target : temp_thread_list)
+            {
+                sp_target->set_quit_flag();
+            }
+
+            /// 停止这些线程
+            for (auto &sp_target : temp_thread_list)
+            {
+                end_one_thread(sp_target, sync);
+            }
+
+            clear_retire_signals();
+        }
+
+    private:
+        /// 队列最多容纳的任务数，环形队列还受容量限制
+        inline int task_slot_limit() const
+        {
+            int limit = m_task_max_count;
+            if (m_queue_mode == PROCESSOR_QUEUE_RING && limit > static_cast<int>(m_task_ring->capacity()))
+            {
+                limit = static_cast<int>(m_task_ring->capacity());
+            }
+
+            return limit;
+        }
+
+        /// 预留count个任务位置，超出上限时失败，成功后必须入队同样数量的任务
+        bool reserve_task_slots(const int count)
+        {
+            const int limit = task_slot_limit();
+
+            int cur_size = m_task_size.load();
+            do
+            {
+                if (cur_size + count > limit)
+                {
+                    return false;
+                }
+            } while (!m_task_size.compare_exchange_weak(cur_size, cur_size + count));
+
+            m_metrics.update_high_water(cur_size + count);
+            return true;
+        }
+
+        /// 写入已预留位置的任务
+        void store_entry(TaskEntry<T> &&entry)
+        {
+            if (m_schedule_mode == PROCESSOR_SCHEDULE_PRIORITY)
+            {
+                store_priority_entry(std::move(entry));
+            }
+            else if (m_queue_mode == PROCESSOR_QUEUE_RING)
+            {
+                /// 位置已预留，失败仅可能是消费者尚未释放槽位
+                while (!m_task_ring->try_push(std::move(entry)))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            else
+            {
+                std::lock_guard<std::mutex> auto_lock(m_task_lock);
+                m_task_list.emplace_back(std::move(entry));
+            }
+        }
+
+        /// 优先级模式下写入任务，批次拆分为单个任务分别确定优先级
+        void store_priority_entry(TaskEntry<T> &&entry)
+        {
+            /// 单个任务直接入队，不经过临时数组
+            if (entry.m_batch == nullptr)
+            {
+                if (!entry.m_classified)
+                {
+                    classify_task(entry.m_task, entry.m_priority, entry.m_deadline_ns);
+                    entry.m_classified = true;
+                }
+
+                std::lock_guard<std::mutex> auto_lock(m_task_lock);
+                PriorityKey key = {entry.m_priority, entry.m_deadline_ns, m_priority_seq++};
+                m_priority_tasks.emplace(key, std::move(entry));
+                return;
+            }
+
+            /// 批次拆分用线程内复用的数组；先换出再使用，classify_task中再次投递时不会互相覆盖
+            static thread_local std::vector<TaskEntry<T>> s_entries;
+            std::vector<TaskEntry<T>> entries;
+            entries.swap(s_entries);
+
+            entries.reserve(static_cast<size_t>(entry.size()));
+            for (size_t i = entry.m_offset; i < entry.m_batch->size(); ++i)
+            {
+                entries.emplace_back((*entry.m_batch)[i]);
+                entries.back().m_enqueue_ns = entry.m_enqueue_ns;
+                entries.back().m_trace_id = entry.m_trace_id;
+                entries.back().m_trace_ns = entry.m_trace_ns;
+            }
+
+            /// 在锁外调用classify_task
+            for (auto &cur_entry : entries)
+            {
+                classify_task(cur_entry.m_task, cur_entry.m_priority, cur_entry.m_deadline_ns);
+                cur_entry.m_classified = true;
+            }
+
+            {
+                std::lock_guard<std::mutex> auto_lock(m_task_lock);
+                for (auto &cur_entry : entries)
+                {
+                    PriorityKey key = {cur_entry.m_priority, cur_entry.m_deadline_ns, m_priority_seq++};
+                    m_priority_tasks.emplace(key, std::move(cur_entry));
+                }
+            }
+
+            entries.clear();
+            entries.swap(s_entries);
+        }
+
+        /// 优先级模式下取出至多max_count个最紧急的任务，过期任务移入p_expired；
+        /// least_urgent为true时从最不紧急的一端取，用于DROP_OLDEST，取出的任务不登记跟踪
+        int take_tasks_priority(std::list<std::shared_ptr<T>> &task, const int max_count, int64_t *p_enqueue_ns,
+                                std::list<std::shared_ptr<T>> *p_expired, const bool least_urgent = false)
+        {
+            int i = 0;
+            int64_t now_ns = p_expired != nullptr ? metrics_now_ns() : 0;
+            std::lock_guard<std::mutex> auto_lock(m_task_lock);
+
+            while (i < max_count && !m_priority_tasks.empty())
+            {
+                auto itr = least_urgent ? std::prev(m_priority_tasks.end()) : m_priority_tasks.begin();
+                TaskEntry<T> &entry = itr->second;
+
+                if (p_expired != nullptr && entry.m_deadline_ns > 0 && entry.m_deadline_ns <= now_ns)
+                {
+                    entry.take(*p_expired, 1);
+                }
+                else
+                {
+                    i += entry.take(task, max_count - i, p_enqueue_ns, !least_urgent);
+                }
+
+                m_priority_tasks.erase(itr);
+            }
+
+            return i;
+        }
+
+        /// 从m_task_list头部取出至多max_count个任务
+        int take_tasks_from_list(std::list<std::shared_ptr<T>> &task, const int max_count,
+                                 int64_t *p_enqueue_ns = nullptr, const bool trace = false)
+        {
+            int i = 0;
+            std::lock_guard<std::mutex> auto_lock(m_task_lock);
+
+            while (i < max_count && !m_task_list.empty())
+            {
+                i += m_task_list.front().take(task, max_count - i, p_enqueue_ns, trace);
+
+                if (m_task_list.front().size() == 0)
+                {
+                    m_task_list.pop_front();
+
+                    if (m_queue_mode == PROCESSOR_QUEUE_RING)
+                    {
+                        --m_ring_leftover;
+                    }
+                }
+            }
+
+            return i;
+        }
+
+        /// 取出至多max_count个任务，返回实际数量；trace见TaskEntry::take
+        int take_tasks(std::list<std::shared_ptr<T>> &task, const int max_count, int64_t *p_enqueue_ns = nullptr,
+                       const bool trace = false)
+        {
+            if (m_queue_mode != PROCESSOR_QUEUE_RING)
+            {
+                return take_tasks_from_list(task, max_count, p_enqueue_ns, trace);
+            }
+
+            int i = 0;
+            if (m_ring_leftover.load() > 0)
+            {
+                i += take_tasks_from_list(task, max_count, p_enqueue_ns, trace);
+            }
+
+            TaskEntry<T> entry;
+            while (i < max_count && m_task_ring->try_pop(entry))
+            {
+                i += entry.take(task, max_count - i, p_enqueue_ns, trace);
+
+                if (entry.size() > 0)
+                {
+                    /// 批次未取完，剩余部分留给下一次读取
+                    std::lock_guard<std::mutex> auto_lock(m_task_lock);
+                    m_task_list.emplace_front(std::move(entry));
+                    ++m_ring_leftover;
+                    break;
+                }
+            }
+
+            return i;
+        }
+
+        /// 当前线程所属的本地队列，非工作线程为空
+        static StealWorker *&current_steal_worker()
+        {
+            static thread_local StealWorker *p_worker = nullptr;
+            return p_worker;
+        }
+
+        /// 当前线程是本单元的工作线程时返回其本地队列
+        StealWorker *local_steal_worker() const
+        {
+            StealWorker *p_worker = current_steal_worker();
+            return (p_worker != nullptr && p_worker->m_owner == this) ? p_worker : nullptr;
+        }
+
+        void attach_steal_worker()
+        {
+            StealWorker *p_worker = nullptr;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_steal_lock);
+
+                /// 优先复用已退出线程留下的本地队列
+                for (auto &sp_worker : m_steal_workers)
+                {
+                    std::lock_guard<std::mutex> worker_lock(sp_worker->m_lock);
+                    if (!sp_worker->m_active)
+                    {
+                        sp_worker->m_active = true;
+                        p_worker = sp_worker.get();
+                        break;
+                    }
+                }
+
+                if (p_worker == nullptr && m_steal_workers.size() < PROCESSOR_STEAL_MAX_WORKERS)
+                {
+                    m_steal_workers.emplace_back(new StealWorker());
+                    p_worker = m_steal_workers.back().get();
+                    p_worker->m_owner = this;
+                    p_worker->m_active = true;
+
+                    const int slot = static_cast<int>(m_steal_workers.size()) - 1;
+                    m_steal_slots[slot].store(p_worker, std::memory_order_release);
+                    m_steal_slot_count.store(slot + 1, std::memory_order_release);
+                }
+            }
+
+            current_steal_worker() = p_worker;
+        }
+
+        /// 线程退出时把本地队列中剩余的任务交还共享队列，计数不变
+        void detach_steal_worker()
+        {
+            StealWorker *p_worker = local_steal_worker();
+            if (p_worker == nullptr)
+            {
+                return;
+            }
+
+            current_steal_worker() = nullptr;
+
+            std::deque<TaskEntry<T>, PoolAllocator<TaskEntry<T>>> tasks;
+            {
+                std::lock_guard<std::mutex> worker_lock(p_worker->m_lock);
+                p_worker->m_active = false;
+                tasks.swap(p_worker->m_tasks);
+            }
+
+            for (auto &entry : tasks)
+            {
+                store_entry(std::move(entry));
+            }
+        }
+
+        /// 工作线程投递时写入自己的本地队列；其他线程投递时轮流写入各工作线程的本地队列，
+        /// 任务一开始就分散到各线程，由各线程就近读取，空闲线程再去窃取
+        bool store_entry_local(TaskEntry<T> &entry)
+        {
+            StealWorker *p_worker = local_steal_worker();
+            if (p_worker != nullptr)
+            {
+                std::lock_guard<std::mutex> worker_lock(p_worker->m_lock);
+                p_worker->m_tasks.emplace_back(std::move(entry));
+                return true;
+            }
+
+            const int slot_count = m_steal_slot_count.load(std::memory_order_acquire);
+            const unsigned int start = m_steal_next.fetch_add(1, std::memory_order_relaxed);
+
+            for (int n = 0; n < slot_count; ++n)
+            {
+                StealWorker *p_target = m_steal_slots[(start + n) % slot_count].load(std::memory_order_acquire);
+
+                std::lock_guard<std::mutex> worker_lock(p_target->m_lock);
+                if (p_target->m_active)
+                {
+                    p_target->m_tasks.emplace_back(std::move(entry));
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// 依次从本地队列、共享队列、其他线程的本地队列取任务，至少取到acquired个（不超过max_count）才返回
+        /// 任务分散在多个队列中，一轮扫描可能错过：其他线程用自己的信号取走了本轮要取的任务，
+        /// 对应的任务却写入了本轮已经看过的队列；此时只要还有已预留的任务就再扫一轮
+        int take_tasks_stealing(std::list<std::shared_ptr<T>> &task, const int max_count, const int acquired,
+                                int64_t *p_enqueue_ns)
+        {
+            const int need_count = acquired < max_count ? acquired : max_count;
+            StealWorker *p_local = local_steal_worker();
+            int i = 0;
+
+            while (true)
+            {
+                if (p_local != nullptr)
+                {
+                    std::lock_guard<std::mutex> auto_lock(p_local->m_lock);
+                    while (i < max_count && !p_local->m_tasks.empty())
+                    {
+                        i += p_local->m_tasks.front().take(task, max_count - i, p_enqueue_ns, true);
+
+                        if (p_local->m_tasks.front().size() == 0)
+                        {
+                            p_local->m_tasks.pop_front();
+                        }
+                    }
+                }
+
+                if (i < max_count)
+                {
+                    i += take_tasks(task, max_count - i, p_enqueue_ns, true);
+                }
+
+                if (i < max_count)
+                {
+                    i += steal_tasks(task, max_count - i, p_local, p_enqueue_ns);
+                }
+
+                /// m_task_size包含本线程已取出的i个，以及其他线程正在写入或正在取出的任务，后两者都很快结束
+                if (i >= need_count || m_task_size.load() <= i)
+                {
+                    return i;
+                }
+
+                std::this_thread::yield();
             }
         }
 
-    public:
-        virtual int
-        push_task(std::list<std::shared_ptr<T>> &task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        /// 从其他线程本地队列尾部窃取，起点随机以分散竞争，每次只锁住当前目标的队列
+        /// oldest为true时从头部取且不给所有者留任务，用于DROP_OLDEST，取出的任务不登记跟踪
+        int steal_tasks(std::list<std::shared_ptr<T>> &task, const int max_count, StealWorker *p_local,
+                        int64_t *p_enqueue_ns, const bool oldest = false)
         {
-            auto task_size = task.size();
-            if (task_size == 0)
+            static thread_local unsigned int seed = static_cast<unsigned int>(
+                    std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+            const int slot_count = m_steal_slot_count.load(std::memory_order_acquire);
+            if (slot_count == 0)
             {
-                return PROCESSOR_FAIL;
+                return 0;
             }
 
-            std::lock_guard<std::mutex> auto_lock(m_task_lock);
+            seed = seed * 1103515245 + 12345;
+            const int start = static_cast<int>((seed >> 16) % static_cast<unsigned int>(slot_count));
+            int i = 0;
 
-            if (m_task_size + task_size > m_task_max_count)
+            for (int n = 0; n < slot_count && i < max_count; ++n)
             {
-                if (m_task_list_full_flag == 0)
+                StealWorker *p_victim = m_steal_slots[(start + n) % slot_count].load(std::memory_order_acquire);
+                if (p_victim == p_local)
                 {
-                    m_task_list_full_flag = 1;
-                    report_queue_full();
+                    continue;
                 }
 
-                if (p_new_size != nullptr)
+                std::lock_guard<std::mutex> victim_lock(p_victim->m_lock);
+
+                if (oldest)
                 {
-                    *p_new_size = m_task_size;
+                    while (i < max_count && !p_victim->m_tasks.empty())
+                    {
+                        i += p_victim->m_tasks.front().take(task, max_count - i, p_enqueue_ns);
+
+                        if (p_victim->m_tasks.front().size() == 0)
+                        {
+                            p_victim->m_tasks.pop_front();
+                        }
+                    }
+
+                    continue;
                 }
 
-                return PROCESSOR_QUEUE_FULL;
+                /// 最多窃取一半，给所有者留下本地任务
+                int steal_count = static_cast<int>((p_victim->m_tasks.size() + 1) / 2);
+                for (int k = 0; k < steal_count && i < max_count; ++k)
+                {
+                    i += p_victim->m_tasks.back().take(task, max_count - i, p_enqueue_ns, true);
+
+                    if (p_victim->m_tasks.back().size() == 0)
+                    {
+                        p_victim->m_tasks.pop_back();
+                    }
+                }
             }
-            else
+
+            return i;
+        }
+
+        /// 预留位置的结果
+        enum
+        {
+            TASK_SLOTS_RESERVED = 0,
+            TASK_SLOTS_FULL = 1,
+            TASK_SLOTS_SPILL = 2
+        };
+
+        /// 按溢出策略为count个任务预留位置
+        int admit_tasks(const int count, const int wait_time_on_queue_full)
+        {
+            const int policy = m_overflow_policy;
+
+            /// 暂存队列非空时新任务排在其后，保证顺序
+            if (policy == PROCESSOR_OVERFLOW_SPILL && m_spill_size.load() > 0)
             {
-                auto task_copy(task);
-                m_task_list.splice(m_task_list.end(), task_copy);
-                m_task_size += task_size;
-                m_task_semphore.signal(task_size);
+                return TASK_SLOTS_SPILL;
+            }
 
-                if (p_new_size != nullptr)
+            /// 比整个队列还大的批次怎么等、丢多少旧任务都放不下，直接拒绝，不先清空队列
+            if (count > task_slot_limit())
+            {
+                return policy == PROCESSOR_OVERFLOW_SPILL ? TASK_SLOTS_SPILL : TASK_SLOTS_FULL;
+            }
+
+            if (reserve_task_slots(count))
+            {
+                return TASK_SLOTS_RESERVED;
+            }
+
+            if (m_task_list_full_flag.exchange(1) == 0)
+            {
+                report_queue_full();
+            }
+
+            int wait_ms = wait_time_on_queue_full;
+            if (wait_ms == 0 && policy == PROCESSOR_OVERFLOW_BLOCK)
+            {
+                wait_ms = m_overflow_wait_ms;
+            }
+
+            if (wait_ms != 0 && wait_task_slots(count, wait_ms))
+            {
+                return TASK_SLOTS_RESERVED;
+            }
+
+            if (policy == PROCESSOR_OVERFLOW_DROP_OLDEST)
+            {
+                while (!reserve_task_slots(count))
                 {
-                    *p_new_size = m_task_size;
+                    if (drop_oldest_tasks(count) == 0)
+                    {
+                        return TASK_SLOTS_FULL;
+                    }
                 }
 
-                return PROCESSOR_SUCCESS;
+                return TASK_SLOTS_RESERVED;
             }
+
+            return policy == PROCESSOR_OVERFLOW_SPILL ? TASK_SLOTS_SPILL : TASK_SLOTS_FULL;
         }
 
-        virtual int push_task(std::shared_ptr<T> &sp_task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        /// 阻塞等待空位，wait_ms小于0表示一直等待
+        bool wait_task_slots(const int count, const int wait_ms)
         {
-            std::lock_guard<std::mutex> auto_lock(m_task_lock);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms < 0 ? 0 : wait_ms);
+            bool reserved = false;
 
-            if (m_task_size >= m_task_max_count)
+            std::unique_lock<std::mutex> ul(m_space_lock);
+            ++m_space_waiters;
+
+            while (!(reserved = reserve_task_slots(count)))
             {
-                if (m_task_list_full_flag == 0)
+                if (wait_ms < 0)
+                {
+                    m_space_cv.wait(ul);
+                }
+                else if (m_space_cv.wait_until(ul, deadline) == std::cv_status::timeout)
                 {
-                    m_task_list_full_flag = 1;
-                    report_queue_full();
+                    reserved = reserve_task_slots(count);
+                    break;
                 }
+            }
 
-                if (p_new_size != nullptr)
+            --m_space_waiters;
+            return reserved;
+        }
+
+        /// 唤醒等待空位的生产者
+        void notify_task_slots()
+        {
+            if (m_space_waiters.load() > 0)
+            {
+                std::lock_guard<std::mutex> auto_lock(m_space_lock);
+                m_space_cv.notify_all();
+            }
+        }
+
+        /// 丢弃最旧的count个任务，返回实际丢弃的数量
+        int drop_oldest_tasks(const int count)
+        {
+            std::list<std::shared_ptr<T>> dropped;
+            int drop_count = (m_schedule_mode == PROCESSOR_SCHEDULE_PRIORITY)
+                             ? take_tasks_priority(dropped, count, nullptr, nullptr, true)
+                             : take_tasks(dropped, count);
+
+            /// 工作窃取模式下任务大多在各线程的本地队列中
+            if (m_schedule_mode == PROCESSOR_SCHEDULE_STEAL && drop_count < count)
+            {
+                drop_count += steal_tasks(dropped, count - drop_count, nullptr, nullptr, true);
+            }
+
+            if (drop_count > 0)
+            {
+                m_task_semphore.unsignal(drop_count);
+                m_task_size -= drop_count;
+                m_metrics.on_drop(drop_count);
+                report_task_dropped(dropped);
+            }
+
+            return drop_count;
+        }
+
+        /// 写入暂存队列
+        void spill_entry(TaskEntry<T> &&entry)
+        {
+            {
+                std::lock_guard<std::mutex> auto_lock(m_spill_lock);
+                m_spill_size += entry.size();
+
+                /// 超过队列容量的批次永远等不到足够的空位，拆成单个任务回填
+                if (entry.m_batch != nullptr && entry.size() > m_task_max_count)
                 {
-                    *p_new_size = m_task_size;
+                    for (size_t i = entry.m_offset; i < entry.m_batch->size(); ++i)
+                    {
+                        m_spill_list.emplace_back((*entry.m_batch)[i]);
+                        m_spill_list.back().m_enqueue_ns = entry.m_enqueue_ns;
+                        m_spill_list.back().m_trace_id = entry.m_trace_id;
+                        m_spill_list.back().m_trace_ns = entry.m_trace_ns;
+                    }
+                }
+                else
+                {
+                    m_spill_list.emplace_back(std::move(entry));
                 }
+            }
+
+            refill_from_spill();
+        }
 
-                return PROCESSOR_QUEUE_FULL;
+        /// 有空位时把暂存队列中的任务按序移入任务队列
+        void refill_from_spill()
+        {
+            if (m_spill_size.load() == 0)
+            {
+                return;
             }
-            else
+
+            int refill_count = 0;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_spill_lock);
+
+                while (!m_spill_list.empty() && reserve_task_slots(m_spill_list.front().size()))
+                {
+                    int entry_size = m_spill_list.front().size();
+                    store_entry(std::move(m_spill_list.front()));
+                    m_spill_list.pop_front();
+                    m_spill_size -= entry_size;
+                    refill_count += entry_size;
+                }
+            }
+
+            if (refill_count > 0)
+            {
+                m_task_semphore.signal(refill_count, wake_count_of(refill_count));
+            }
+        }
+
+        /// 取走count个任务需要唤醒的工作线程数，每个线程一次最多读取m_batch_number个
+        inline int wake_count_of(const int count) const
+        {
+            const int batch_number = m_batch_number > 0 ? m_batch_number : 1;
+            return (count + batch_number - 1) / batch_number;
+        }
+
+        /// 按溢出策略写入一项任务
+        int push_entry(TaskEntry<T> &&entry, int *p_new_size, const int wait_time_on_queue_full)
+        {
+            const int entry_size = entry.size();
+            int result = PROCESSOR_SUCCESS;
+
+            /// 先登记再检查，排空时能等到已通过检查的投递完成
+            ++m_pushing;
+            if (m_accepting.load() == 0)
             {
-                m_task_list.emplace_back(sp_task);
-                ++m_task_size;
-                m_task_semphore.signal();
+                --m_pushing;
+                m_metrics.on_drop(entry_size);
 
                 if (p_new_size != nullptr)
                 {
                     *p_new_size = m_task_size;
                 }
 
-                return PROCESSOR_SUCCESS;
+                return PROCESSOR_STOPPED;
+            }
+
+            if (m_metrics_timing_flag != 0)
+            {
+                entry.m_enqueue_ns = metrics_now_ns();
+            }
+
+            if (Tracer::instance().is_enabled())
+            {
+                entry.m_trace_id = Tracer::instance().on_push(m_processor_id, &entry.m_trace_ns);
+            }
+
+            switch (admit_tasks(entry_size, wait_time_on_queue_full))
+            {
+                case TASK_SLOTS_RESERVED:
+                    if (m_schedule_mode != PROCESSOR_SCHEDULE_STEAL || !store_entry_local(entry))
+                    {
+                        store_entry(std::move(entry));
+                    }
+
+                    m_task_semphore.signal(entry_size, wake_count_of(entry_size));
+                    m_metrics.on_enqueue(entry_size);
+                    break;
+
+                case TASK_SLOTS_SPILL:
+                    spill_entry(std::move(entry));
+                    m_metrics.on_enqueue(entry_size);
+                    break;
+
+                default:
+                    result = PROCESSOR_QUEUE_FULL;
+                    m_metrics.on_drop(entry_size);
+                    break;
+            }
+
+            --m_pushing;
+
+            if (p_new_size != nullptr)
+            {
+                *p_new_size = m_task_size;
+            }
+
+            return result;
+        }
+
+    public:
+        /// 从池中创建任务，对象与引用计数共用一个块，释放后由当前线程复用
+        template<typename... Args>
+        static std::shared_ptr<T> make_task(Args &&... args)
+        {
+            return make_pooled<T>(std::forward<Args>(args)...);
+        }
+
+        /// wait_time_on_queue_full大于0时队列满最多等待该时间，小于0一直等待，
+        /// 等于0时按set_overflow_policy设置的策略处理
+        virtual int
+        push_task(std::list<std::shared_ptr<T>> &task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            if (task.empty())
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            /// 整个列表作为一个批次入队，只分配一次
+            SP_TASK_BATCH<T> sp_batch(make_task_batch<T>(task.begin(), task.end()));
+            return push_entry(TaskEntry<T>(sp_batch), p_new_size, wait_time_on_queue_full);
+        }
+
+        virtual int push_task(std::shared_ptr<T> &sp_task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            return push_entry(TaskEntry<T>(sp_task), p_new_size, wait_time_on_queue_full);
+        }
+
+        /// 指定优先级与截止时间投递，priority越小越紧急，deadline_ns为metrics_now_ns()时钟下的绝对时间，0表示没有截止时间
+        /// 仅PROCESSOR_SCHEDULE_PRIORITY模式下生效，其他模式下等同push_task
+        virtual int push_priority_task(std::shared_ptr<T> &sp_task, const int priority, const int64_t deadline_ns = 0,
+                                       int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            TaskEntry<T> entry(sp_task);
+            entry.m_priority = priority;
+            entry.m_deadline_ns = deadline_ns;
+            entry.m_classified = true;
+            return push_entry(std::move(entry), p_new_size, wait_time_on_queue_full);
+        }
+
+        /// 投递共享的不可变批次，不复制任务，读取时按m_batch_number拆分
+        virtual int
+        push_batch(const SP_TASK_BATCH<T> &sp_batch, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            if (sp_batch == nullptr || sp_batch->empty())
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            return push_entry(TaskEntry<T>(sp_batch), p_new_size, wait_time_on_queue_full);
+        }
+
+        /// 批量投递[first, last)中的任务：一次预留全部位置、一次入队、一次唤醒，
+        /// 唤醒的工作线程数不超过按m_batch_number读取完这些任务所需的数量
+        /// 迭代器的值类型须能转换为std::shared_ptr<T>，传入std::make_move_iterator可避免引用计数的增减
+        template<typename Iterator>
+        int push_tasks(Iterator first, Iterator last, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            if (first == last)
+            {
+                return PROCESSOR_FAIL;
             }
+
+            SP_TASK_BATCH<T> sp_batch(make_task_batch<T>(first, last));
+            return push_batch(sp_batch, p_new_size, wait_time_on_queue_full);
+        }
+
+        /// 批量投递连续存放的count个任务
+        int push_tasks(const std::shared_ptr<T> *p_tasks, const size_t count, int *p_new_size = nullptr,
+                       int wait_time_on_queue_full = 0)
+        {
+            if (p_tasks == nullptr)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            return push_tasks(p_tasks, p_tasks + count, p_new_size, wait_time_on_queue_full);
         }
 
+    private:
+        /// 从当前调度模式对应的队列中取任务并释放位置，acquired为等待时已取走的信号数
+        /// track_inflight为true时计入m_inflight_count，由工作线程处理完后扣除
+        int take_and_release_tasks(std::list<std::shared_ptr<T>> &task, const int max_count, const int acquired,
+                                   const bool track_inflight)
+        {
+            int64_t enqueue_ns = 0;
+            std::list<std::shared_ptr<T>> expired;
+            int i = 0;
+
+            switch (m_schedule_mode)
+            {
+                case PROCESSOR_SCHEDULE_STEAL:
+                    i = take_tasks_stealing(task, max_count, acquired, &enqueue_ns);
+                    break;
+
+                case PROCESSOR_SCHEDULE_PRIORITY:
+                    i = take_tasks_priority(task, max_count, &enqueue_ns, &expired);
+                    break;
+
+                default:
+                    i = take_tasks(task, max_count, &enqueue_ns, true);
+
+                    /// 环形队列中的任务对持有信号的线程可能暂时不可见：生产者已占位尚未写完，
+                    /// 或其他线程取出了批次、还没把剩余部分放回m_task_list；直接返回会留下没有信号对应的任务，
+                    /// 因此一个都没取到时只要还有已预留的任务就再取，两种情况都很快结束
+                    while (i == 0 && m_queue_mode == PROCESSOR_QUEUE_RING && m_task_size.load() > 0)
+                    {
+                        std::this_thread::yield();
+                        i = take_tasks(task, max_count, &enqueue_ns, true);
+                    }
+                    break;
+            }
+
+            /// 过期任务同样占用信号和位置
+            const int expired_count = static_cast<int>(expired.size());
+            if (i + expired_count > acquired)
+            {
+                m_task_semphore.unsignal(i + expired_count - acquired);
+            }
+
+            if (i > 0)
+            {
+                /// 先计入处理中再释放位置，wait_idle()不会看到任务暂时消失
+                if (track_inflight)
+                {
+                    m_inflight_count += i;
+                }
+
+                m_metrics.on_dequeue(i, enqueue_ns, enqueue_ns > 0 ? metrics_now_ns() : 0);
+            }
+
+            if (i + expired_count > 0)
+            {
+                m_task_size -= i + expired_count;
+                refill_from_spill();
+                notify_task_slots();
+            }
+
+            if (expired_count > 0)
+            {
+                m_metrics.on_expire(expired_count);
+                report_task_expired(expired);
+            }
+
+            return i;
+        }
 
+    public:
+        /// 读取一批任务：ms内没有任何任务返回PROCESSOR_TIME_OUT，ms为0时只检查一次，不自旋等待；
+        /// 读到的任务不足m_batch_min_number时最多再等待m_batch_linger_ms
         int pop_task(std::list<std::shared_ptr<T>> &task, const int ms = (-1), int *p_new_size = nullptr)
         {
-            if (m_task_semphore.wait(ms, m_batch_number) != SEMPHORE_SUCCESS)
+            int result = pop_tasks(task, ms, p_new_size, nullptr);
+
+            /// 只记录排队时间，处理过程不在单元内
+            if (result == PROCESSOR_SUCCESS && Tracer::instance().is_enabled() &&
+                Tracer::instance().begin_batch(m_processor_id))
             {
-                // return PROCESSOR_TIME_OUT;
+                Tracer::discard_batch();
             }
 
-            std::lock_guard<std::mutex> auto_lock(m_task_lock);
+            return result;
+        }
+
+    protected:
+        /// p_worker为工作线程时取出的任务计入m_inflight_count，处理完后由调用者扣除；
+        /// 取到的信号是缩容信号时设置其退出标志并返回PROCESSOR_QUEUE_EMPTY
+        int pop_tasks(std::list<std::shared_ptr<T>> &task, const int ms, int *p_new_size, ThreadWrapper *p_worker)
+        {
+            int wait_result = ms == 0 ? m_task_semphore.try_wait(1) : m_task_semphore.wait(ms, 1);
+            if (wait_result == SEMPHORE_SUCCESS && p_worker != nullptr && take_retire_signal())
+            {
+                p_worker->m_retire_flag = 1;
+                p_worker->set_quit_flag();
+                wait_result = SEMPHORE_INTERRUPT;
+            }
+
+            if (wait_result != SEMPHORE_SUCCESS)
+            {
+                if (p_new_size != nullptr)
+                {
+                    *p_new_size = m_task_size;
+                }
+
+                /// 被wake_idle_threads()唤醒时不算超时
+                return wait_result == SEMPHORE_TIME_OUT ? PROCESSOR_TIME_OUT : PROCESSOR_QUEUE_EMPTY;
+            }
 
-            if (m_task_list_full_flag != 0)
+            if (m_task_list_full_flag.load(std::memory_order_relaxed) != 0 && m_task_list_full_flag.exchange(0) != 0)
             {
-                m_task_list_full_flag = 0;
                 report_queue_changed_to_not_full();
             }
 
-            int i = 0;
-            for (; i < m_batch_number; ++i)
+            const int max_count = m_batch_number > 0 ? m_batch_number : 1;
+            const int min_count = m_batch_min_number < max_count ? m_batch_min_number : max_count;
+
+            const bool track_inflight = p_worker != nullptr;
+            int i = take_and_release_tasks(task, max_count, 1, track_inflight);
+
+            /// 批量投递只唤醒了按m_batch_number估算的线程数，取满一批且还有剩余信号时才接力唤醒下一个
+            if (max_count > 1 && i == max_count && m_task_semphore.count() > 0)
+            {
+                m_task_semphore.wake(1);
+            }
+
+            if (i < min_count && m_batch_linger_ms > 0)
             {
-                if (m_task_list.empty())
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_batch_linger_ms);
+
+                while (i < min_count)
                 {
-                    if (p_new_size != nullptr)
+                    auto remain_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+
+                    const int need_count = min_count - i;
+                    if (remain_ms <= 0 || m_task_semphore.wait(static_cast<int>(remain_ms), need_count) !=
+                                          SEMPHORE_SUCCESS)
                     {
-                        *p_new_size = 0;
+                        break;
                     }
 
-                    break;
+                    i += take_and_release_tasks(task, max_count - i, need_count, track_inflight);
                 }
 
-                std::shared_ptr<T> sp_task = std::move(m_task_list.front());
-                m_task_list.pop_front();
-                task.emplace_back(sp_task);
+                /// 凑批超时，带走期间到达的任务
+                if (i < max_count)
+                {
+                    i += take_and_release_tasks(task, max_count - i, 0, track_inflight);
+                }
             }
 
-            m_task_semphore.unsignal(i);
-            m_task_size -= i;
-
             if (p_new_size != nullptr)
             {
                 *p_new_size = m_task_size;
             }
 
-            return PROCESSOR_SUCCESS;
+            if (i > 0)
+            {
+                m_metrics.on_batch(i);
+            }
+
+            return i > 0 ? PROCESSOR_SUCCESS : PROCESSOR_QUEUE_EMPTY;
         }
     };
 
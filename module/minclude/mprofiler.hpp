@@ -0,0 +1,743 @@
+#ifndef __M_PROFILER_HPP_
+#define __M_PROFILER_HPP_
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#endif
+
+#include <boost/stacktrace/frame.hpp>
+
+#include "mevent.hpp"
+#include "mthread.hpp"
+
+/// 旧版glibc没有定义该字段名
+#if defined(__linux__) && !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace m_module_space
+{
+
+    enum
+    {
+        PROFILER_MAX_DEPTH = 64,        /// 单个样本最多记录的栈帧数
+        PROFILER_RING_CAPACITY = 1024,  /// 默认样本缓冲容量，向上取整为2的幂，写满后丢弃新样本
+        PROFILER_INTERVAL_US = 10000,   /// 默认每个线程每消耗10ms CPU时间采样一次
+        PROFILER_FLUSH_MS = 1000        /// 默认汇总及写文件的周期
+    };
+
+    /// 采样参数
+    struct ProfilerPolicy
+    {
+        int m_interval_us = PROFILER_INTERVAL_US; /// 线程CPU时间的采样间隔，开销大致与其成反比
+        int m_max_depth = PROFILER_MAX_DEPTH;     /// 不超过PROFILER_MAX_DEPTH
+        int m_ring_capacity = PROFILER_RING_CAPACITY;
+        int m_flush_ms = PROFILER_FLUSH_MS;       /// 汇总样本、发现新线程的周期
+        std::string m_output_path;                /// 非空时每个周期把累计结果写为折叠栈文件
+        bool m_thread_root = true;                /// 以线程名作为栈底，按线程区分流水线单元
+    };
+
+    /// 进程内采样分析器：为进程的每个线程创建以该线程CPU时间计时的timer，到期向该线程发送SIGPROF，
+    /// 信号处理函数沿帧指针链取栈写入无锁缓冲；后台线程定期取出样本、符号化，
+    /// 按折叠栈格式（"root;caller;callee count"）累计，可直接交给flamegraph.pl或speedscope
+    /// 新建的线程在下一个汇总周期被发现，不需要线程自行登记
+    /// 只统计消耗CPU的时间，阻塞等待不产生样本；未导出的符号显示为"模块+偏移"，链接时加-rdynamic可显示函数名
+    /// 默认不运行，调用start()后才创建timer、安装信号处理函数
+    ///
+    /// 取栈不使用_Unwind_Backtrace：它会获取dl_iterate_phdr的锁，信号打断持有该锁的线程（dlopen、抛出异常）时死锁。
+    /// 帧指针链只读栈内存，每个新的内存页先用process_vm_readv确认可读，链损坏时在该处截断而不会崩溃；
+    /// 因此需要以-fno-omit-frame-pointer编译被分析的代码，否则省略帧指针的函数及其调用者会缺失或栈被截短。
+    /// 系统禁止process_vm_readv（如seccomp）时只记录被中断的位置
+    /// 旧版glibc需要链接rt与dl
+    class SamplingProfiler
+    {
+    public:
+        static SamplingProfiler &instance()
+        {
+            static SamplingProfiler s_profiler;
+            return s_profiler;
+        }
+
+        ~SamplingProfiler()
+        {
+            stop();
+        }
+
+    private:
+        SamplingProfiler() :
+                m_running(false),
+                m_p_ring(nullptr),
+                m_samples(0),
+                m_dropped(0),
+                m_handler_installed(false),
+                m_report_thread_id(0)
+        {
+
+        }
+
+        SamplingProfiler(const SamplingProfiler &) = delete;
+
+        SamplingProfiler &operator=(const SamplingProfiler &) = delete;
+
+    private:
+        /// 缓冲槽位，m_sequence等于写入序号时可写，等于写入序号+1时可读
+        struct Slot
+        {
+            std::atomic<uint64_t> m_sequence;
+            int m_thread_id;
+            int m_depth;
+            void *m_frames[PROFILER_MAX_DEPTH + 1];
+        };
+
+        /// 样本缓冲，容量、掩码与序号随缓冲一起替换，信号处理函数取到的总是一组一致的值
+        struct Ring
+        {
+            explicit Ring(const uint64_t capacity) :
+                    m_capacity(capacity),
+                    m_mask(capacity - 1),
+                    m_write_index(0),
+                    m_read_index(0),
+                    m_slots(new Slot[capacity])
+            {
+                for (uint64_t i = 0; i < m_capacity; ++i)
+                {
+                    m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            const uint64_t m_capacity;
+            const uint64_t m_mask;
+            std::atomic<uint64_t> m_write_index;
+            uint64_t m_read_index; /// 只由持有m_lock的线程读写
+            std::unique_ptr<Slot[]> m_slots;
+        };
+
+        /// 已创建timer的线程
+        struct ThreadTimer
+        {
+            timer_t m_timer;
+            std::string m_name;
+        };
+
+        std::atomic<bool> m_running;
+        std::atomic<Ring *> m_p_ring; /// 信号处理函数使用的缓冲，start()换缓冲时整体替换
+        std::unique_ptr<Ring> m_sp_ring; /// 当前缓冲，由m_lock保护
+        std::vector<std::unique_ptr<Ring>> m_retired_rings; /// 停止后可能仍有信号处理函数在写，旧缓冲不释放
+        std::atomic<int> m_max_depth{PROFILER_MAX_DEPTH};
+        std::atomic<uint64_t> m_samples;
+        std::atomic<uint64_t> m_dropped;
+        std::atomic<int> m_pid{0};
+        std::atomic<bool> m_frame_walk{false}; /// process_vm_readv可用，可以沿帧指针链取栈
+
+        std::mutex m_lock; /// 保护以下成员
+        ProfilerPolicy m_policy;
+        bool m_handler_installed;
+        std::map<int, ThreadTimer> m_timers;
+        std::map<std::string, uint64_t> m_folded;
+        std::map<void *, std::string> m_symbols;
+
+        std::mutex m_thread_lock;
+        std::shared_ptr<std::thread> m_sp_report_thread;
+        Event m_report_quit_event;
+        std::atomic<int> m_report_thread_id;
+
+        static inline int current_thread_id()
+        {
+#if defined(__linux__)
+            return static_cast<int>(syscall(SYS_gettid));
+#else
+            return 0;
+#endif
+        }
+
+        /// 被中断时的指令地址、栈指针与帧指针，取不到时为0
+        static inline void interrupted_registers(void *p_context, uintptr_t &pc, uintptr_t &sp, uintptr_t &fp)
+        {
+#if defined(__linux__) && defined(__x86_64__)
+            const mcontext_t &context = static_cast<ucontext_t *>(p_context)->uc_mcontext;
+            pc = static_cast<uintptr_t>(context.gregs[REG_RIP]);
+            sp = static_cast<uintptr_t>(context.gregs[REG_RSP]);
+            fp = static_cast<uintptr_t>(context.gregs[REG_RBP]);
+#elif defined(__linux__) && defined(__aarch64__)
+            const mcontext_t &context = static_cast<ucontext_t *>(p_context)->uc_mcontext;
+            pc = static_cast<uintptr_t>(context.pc);
+            sp = static_cast<uintptr_t>(context.sp);
+            fp = static_cast<uintptr_t>(context.regs[29]);
+#else
+            pc = sp = fp = 0;
+#endif
+        }
+
+        /// 确认address所在的页可读，异步信号安全；不可读时process_vm_readv返回EFAULT而不是触发SIGSEGV
+        static inline bool readable_page(const int pid, const uintptr_t address)
+        {
+#if defined(__linux__)
+            char byte;
+            struct iovec local = {&byte, 1};
+            struct iovec remote = {reinterpret_cast<void *>(address), 1};
+            return syscall(SYS_process_vm_readv, pid, &local, 1, &remote, 1, 0) == 1;
+#else
+            return false;
+#endif
+        }
+
+        static void on_signal(int, siginfo_t *, void *p_context)
+        {
+            const int saved_errno = errno;
+            SamplingProfiler &profiler = instance();
+
+            if (profiler.m_running.load(std::memory_order_acquire))
+            {
+                uintptr_t pc, sp, fp;
+                interrupted_registers(p_context, pc, sp, fp);
+                profiler.record_sample(pc, sp, fp);
+            }
+
+            errno = saved_errno;
+        }
+
+        /// 从被中断的帧开始沿帧指针链记录返回地址，x86-64与AArch64的帧记录都是[上一帧指针, 返回地址]
+        /// 帧指针须在栈指针之上、按8字节对齐且逐帧增大，不满足时截断
+        int walk_frames(const uintptr_t pc, const uintptr_t sp, uintptr_t fp, void **p_frames, const int max_depth)
+        {
+            static const uintptr_t s_page_size = 4096;
+            static const uintptr_t s_max_frame_size = 16 * 1024 * 1024;
+
+            if (pc == 0 || max_depth <= 0)
+            {
+                return 0;
+            }
+
+            p_frames[0] = reinterpret_cast<void *>(pc);
+            int depth = 1;
+
+            if (!m_frame_walk.load(std::memory_order_relaxed))
+            {
+                return depth;
+            }
+
+            const int pid = m_pid.load(std::memory_order_relaxed);
+            uintptr_t checked_lower = 0; /// 已确认可读的连续页
+            uintptr_t checked_upper = 0;
+
+            while (depth < max_depth && fp >= sp && (fp & (sizeof(uintptr_t) - 1)) == 0)
+            {
+                const uintptr_t record_end = fp + 2 * sizeof(uintptr_t);
+                if (fp < checked_lower || record_end > checked_upper)
+                {
+                    const uintptr_t page = fp & ~(s_page_size - 1);
+                    const uintptr_t last_page = (record_end - 1) & ~(s_page_size - 1);
+                    if (!readable_page(pid, page) || (last_page != page && !readable_page(pid, last_page)))
+                    {
+                        break;
+                    }
+
+                    /// 栈向高地址回溯，与已确认的区间相邻时合并
+                    checked_lower = checked_upper == page ? checked_lower : page;
+                    checked_upper = last_page + s_page_size;
+                }
+
+                const uintptr_t *p_record = reinterpret_cast<const uintptr_t *>(fp);
+                const uintptr_t next_fp = p_record[0];
+                const uintptr_t return_address = p_record[1];
+
+                if (return_address == 0)
+                {
+                    break;
+                }
+
+                p_frames[depth++] = reinterpret_cast<void *>(return_address);
+
+                if (next_fp <= fp || next_fp - fp > s_max_frame_size)
+                {
+                    break;
+                }
+
+                fp = next_fp;
+            }
+
+            return depth;
+        }
+
+        /// 在信号处理函数中执行，只使用原子操作、栈内存读取与process_vm_readv
+        void record_sample(const uintptr_t pc, const uintptr_t sp, const uintptr_t fp)
+        {
+            Ring *p_ring = m_p_ring.load(std::memory_order_acquire);
+            if (p_ring == nullptr)
+            {
+                return;
+            }
+
+            uint64_t index = p_ring->m_write_index.load(std::memory_order_relaxed);
+            Slot *p_slot = nullptr;
+
+            while (true)
+            {
+                p_slot = &p_ring->m_slots[index & p_ring->m_mask];
+                const uint64_t sequence = p_slot->m_sequence.load(std::memory_order_acquire);
+
+                if (sequence == index)
+                {
+                    if (p_ring->m_write_index.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (sequence < index)
+                {
+                    /// 后台线程来不及取走，丢弃本次样本
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else
+                {
+                    index = p_ring->m_write_index.load(std::memory_order_relaxed);
+                }
+            }
+
+            p_slot->m_depth = walk_frames(pc, sp, fp, p_slot->m_frames, m_max_depth.load(std::memory_order_relaxed));
+            p_slot->m_thread_id = current_thread_id();
+            p_slot->m_sequence.store(index + 1, std::memory_order_release);
+            m_samples.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool install_handler()
+        {
+            if (m_handler_installed)
+            {
+                return true;
+            }
+
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_sigaction = &SamplingProfiler::on_signal;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+
+            /// 停止后不恢复原处理函数：已发出未处理的SIGPROF在默认处理下会终止进程
+            m_handler_installed = sigaction(SIGPROF, &action, nullptr) == 0;
+            return m_handler_installed;
+        }
+
+#if defined(__linux__)
+        /// 其他线程的CPU时钟，与glibc的pthread_getcpuclockid编码相同
+        static inline clockid_t thread_cpu_clock(const int thread_id)
+        {
+            return static_cast<clockid_t>((~static_cast<unsigned int>(thread_id) << 3) | 6);
+        }
+
+        static std::string read_thread_name(const int thread_id)
+        {
+            std::ifstream in("/proc/self/task/" + std::to_string(thread_id) + "/comm");
+            std::string name;
+            std::getline(in, name);
+            return name.empty() ? "thread-" + std::to_string(thread_id) : name;
+        }
+
+        /// 为新线程创建timer，删除已退出线程的timer，调用者持有m_lock
+        void scan_threads()
+        {
+            std::set<int> alive;
+            DIR *p_dir = opendir("/proc/self/task");
+            if (p_dir == nullptr)
+            {
+                return;
+            }
+
+            struct dirent *p_entry = nullptr;
+            while ((p_entry = readdir(p_dir)) != nullptr)
+            {
+                const int thread_id = std::atoi(p_entry->d_name);
+                if (thread_id > 0 && thread_id != m_report_thread_id.load())
+                {
+                    alive.insert(thread_id);
+                }
+            }
+
+            closedir(p_dir);
+
+            for (auto itr = m_timers.begin(); itr != m_timers.end();)
+            {
+                if (alive.count(itr->first) == 0)
+                {
+                    timer_delete(itr->second.m_timer);
+                    itr = m_timers.erase(itr);
+                }
+                else
+                {
+                    ++itr;
+                }
+            }
+
+            for (auto thread_id : alive)
+            {
+                auto itr = m_timers.find(thread_id);
+                if (itr != m_timers.end())
+                {
+                    /// 线程启动后才设置名称
+                    itr->second.m_name = read_thread_name(thread_id);
+                    continue;
+                }
+
+                struct sigevent event;
+                memset(&event, 0, sizeof(event));
+                event.sigev_notify = SIGEV_THREAD_ID;
+                event.sigev_signo = SIGPROF;
+                event.sigev_notify_thread_id = thread_id;
+
+                ThreadTimer thread_timer;
+                if (timer_create(thread_cpu_clock(thread_id), &event, &thread_timer.m_timer) != 0)
+                {
+                    continue;
+                }
+
+                struct itimerspec spec;
+                spec.it_interval.tv_sec = m_policy.m_interval_us / 1000000;
+                spec.it_interval.tv_nsec = (m_policy.m_interval_us % 1000000) * 1000;
+                spec.it_value = spec.it_interval;
+
+                if (timer_settime(thread_timer.m_timer, 0, &spec, nullptr) != 0)
+                {
+                    timer_delete(thread_timer.m_timer);
+                    continue;
+                }
+
+                thread_timer.m_name = read_thread_name(thread_id);
+                m_timers[thread_id] = thread_timer;
+            }
+        }
+
+        void delete_timers()
+        {
+            for (auto &cur : m_timers)
+            {
+                timer_delete(cur.second.m_timer);
+            }
+
+            m_timers.clear();
+        }
+#else
+        void scan_threads() {}
+
+        void delete_timers() {}
+#endif
+
+        /// 地址对应的函数名，没有符号时为"模块+偏移"
+        const std::string &symbol_of(void *address)
+        {
+            auto itr = m_symbols.find(address);
+            if (itr != m_symbols.end())
+            {
+                return itr->second;
+            }
+
+            std::string name(boost::stacktrace::frame(address).name());
+#if defined(__linux__)
+            if (name.empty())
+            {
+                Dl_info info;
+                if (dladdr(address, &info) != 0 && info.dli_fname != nullptr)
+                {
+                    std::string module(info.dli_fname);
+                    size_t pos = module.rfind('/');
+                    std::stringstream ss;
+                    ss << (pos == std::string::npos ? module : module.substr(pos + 1)) << "+0x" << std::hex
+                       << (reinterpret_cast<uintptr_t>(address) - reinterpret_cast<uintptr_t>(info.dli_fbase));
+                    name = ss.str();
+                }
+            }
+#endif
+            if (name.empty())
+            {
+                std::stringstream ss;
+                ss << "0x" << std::hex << reinterpret_cast<uintptr_t>(address);
+                name = ss.str();
+            }
+
+            /// 折叠栈格式以分号分隔帧、以最后一个空格分隔计数
+            for (auto &c : name)
+            {
+                if (c == ';' || c == '\n')
+                {
+                    c = ',';
+                }
+            }
+
+            return m_symbols.emplace(address, name).first->second;
+        }
+
+        /// 取出缓冲中的样本累计到m_folded，调用者持有m_lock
+        void drain_samples()
+        {
+            Ring *p_ring = m_sp_ring.get();
+
+            while (p_ring != nullptr)
+            {
+                Slot &slot = p_ring->m_slots[p_ring->m_read_index & p_ring->m_mask];
+                if (slot.m_sequence.load(std::memory_order_acquire) != p_ring->m_read_index + 1)
+                {
+                    break;
+                }
+
+                /// 第一帧是被中断的位置，其余为返回地址，减1后落在调用指令内
+
+                std::string stack;
+                if (m_policy.m_thread_root)
+                {
+                    auto itr = m_timers.find(slot.m_thread_id);
+                    stack = itr != m_timers.end() ? itr->second.m_name : "thread-" + std::to_string(slot.m_thread_id);
+                }
+
+                for (int i = slot.m_depth - 1; i >= 0; --i)
+                {
+                    void *address = slot.m_frames[i];
+                    if (i > 0)
+                    {
+                        address = static_cast<char *>(address) - 1;
+                    }
+
+                    if (!stack.empty())
+                    {
+                        stack += ';';
+                    }
+
+                    stack += symbol_of(address);
+                }
+
+                ++m_folded[stack];
+
+                slot.m_sequence.store(p_ring->m_read_index + p_ring->m_capacity, std::memory_order_release);
+                ++p_ring->m_read_index;
+            }
+        }
+
+        bool write_file(const std::string &path)
+        {
+            std::string text;
+            format_folded(text);
+
+            std::ofstream out(path, std::ios::out | std::ios::trunc);
+            if (!out)
+            {
+                return false;
+            }
+
+            out << text;
+            return static_cast<bool>(out);
+        }
+
+        void format_folded(std::string &text) const
+        {
+            std::stringstream ss;
+            for (auto &cur : m_folded)
+            {
+                ss << cur.first << ' ' << cur.second << '\n';
+            }
+
+            text = ss.str();
+        }
+
+        /// 每个周期取出样本、发现新线程、按需写文件
+        void report_loop()
+        {
+            set_current_thread_name("profiler");
+            m_report_thread_id.store(current_thread_id());
+
+            int flush_ms = PROFILER_FLUSH_MS;
+            while (true)
+            {
+                {
+                    /// 先取样本再删除已退出线程的timer，样本仍能对应到线程名
+                    std::lock_guard<std::mutex> auto_lock(m_lock);
+                    drain_samples();
+                    scan_threads();
+
+                    if (!m_policy.m_output_path.empty())
+                    {
+                        write_file(m_policy.m_output_path);
+                    }
+
+                    flush_ms = m_policy.m_flush_ms;
+                }
+
+                if (m_report_quit_event.wait(flush_ms) != EVENT_TIME_OUT)
+                {
+                    break;
+                }
+            }
+        }
+
+    public:
+        /// 开始采样，已在采样时先停止，样本缓冲按新的参数重建，已累计的结果保留
+        bool start(const ProfilerPolicy &policy = ProfilerPolicy())
+        {
+            if (policy.m_interval_us <= 0 || policy.m_flush_ms <= 0 || policy.m_ring_capacity <= 0 ||
+                policy.m_max_depth <= 0)
+            {
+                return false;
+            }
+
+            stop();
+
+            std::lock_guard<std::mutex> thread_lock(m_thread_lock);
+            {
+                std::lock_guard<std::mutex> auto_lock(m_lock);
+                m_policy = policy;
+                m_max_depth.store(policy.m_max_depth < PROFILER_MAX_DEPTH ? policy.m_max_depth : PROFILER_MAX_DEPTH);
+
+                uint64_t capacity = 1;
+                while (capacity < static_cast<uint64_t>(policy.m_ring_capacity))
+                {
+                    capacity <<= 1;
+                }
+
+                /// 容量不变时沿用原缓冲，序号继续递增；否则先取走停止后才写入的样本，再整体换成新缓冲，
+                /// 仍在旧缓冲上执行的信号处理函数用的是旧缓冲自己的容量与序号
+                if (m_sp_ring == nullptr || capacity != m_sp_ring->m_capacity)
+                {
+                    drain_samples();
+
+                    std::unique_ptr<Ring> sp_ring;
+                    try
+                    {
+                        sp_ring.reset(new Ring(capacity));
+                    }
+                    catch (...)
+                    {
+                        return false;
+                    }
+
+                    m_p_ring.store(sp_ring.get(), std::memory_order_release);
+
+                    if (m_sp_ring != nullptr)
+                    {
+                        m_retired_rings.emplace_back(std::move(m_sp_ring));
+                    }
+
+                    m_sp_ring = std::move(sp_ring);
+                }
+
+                /// 用当前栈确认process_vm_readv可用，不可用时只记录被中断的位置
+                const int pid = static_cast<int>(getpid());
+                int probe = 0;
+                m_pid.store(pid);
+                m_frame_walk.store(readable_page(pid, reinterpret_cast<uintptr_t>(&probe)));
+
+                if (!install_handler())
+                {
+                    return false;
+                }
+
+                m_running.store(true, std::memory_order_release);
+            }
+
+            m_report_quit_event.reset();
+            m_report_thread_id.store(0);
+
+            try
+            {
+                m_sp_report_thread = std::make_shared<std::thread>([this]() -> void {
+                    this->report_loop();
+                });
+            }
+            catch (...)
+            {
+                m_sp_report_thread.reset();
+                m_running.store(false, std::memory_order_release);
+                return false;
+            }
+
+            return true;
+        }
+
+        /// 停止采样，取出剩余样本并写最后一次文件
+        void stop()
+        {
+            std::lock_guard<std::mutex> thread_lock(m_thread_lock);
+
+            if (m_sp_report_thread != nullptr && m_sp_report_thread->joinable())
+            {
+                m_report_quit_event.set();
+                m_sp_report_thread->join();
+            }
+
+            m_sp_report_thread.reset();
+
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            m_running.store(false, std::memory_order_release);
+            drain_samples();
+            delete_timers();
+
+            if (!m_policy.m_output_path.empty() && !m_folded.empty())
+            {
+                write_file(m_policy.m_output_path);
+            }
+        }
+
+        inline bool is_running() const
+        {
+            return m_running.load(std::memory_order_relaxed);
+        }
+
+        /// 导出累计的折叠栈，每行"帧;帧;... 样本数"
+        void export_folded(std::string &text)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            drain_samples();
+            format_folded(text);
+        }
+
+        bool export_folded_file(const std::string &path)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            drain_samples();
+            return write_file(path);
+        }
+
+        /// 清空已累计的结果
+        void clear()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            drain_samples();
+            m_folded.clear();
+        }
+
+        /// 写入缓冲的样本数
+        inline uint64_t samples() const
+        {
+            return m_samples.load(std::memory_order_relaxed);
+        }
+
+        /// 缓冲满而丢弃的样本数，持续增长时应加大m_ring_capacity或缩短m_flush_ms
+        inline uint64_t dropped() const
+        {
+            return m_dropped.load(std::memory_order_relaxed);
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef __M_QUEUE_HPP_
+#define __M_QUEUE_HPP_
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace m_module_space
+{
+
+    /// 有界多生产者多消费者无锁环形队列
+    /// 容量向上取整为2的幂，每个槽位带序号，入队出队均不分配内存
+    template<typename T>
+    class RingQueue
+    {
+    public:
+        explicit RingQueue(size_t capacity = 1024) :
+                m_capacity(round_up_power_of_two(capacity)),
+                m_mask(m_capacity - 1),
+                m_cells(new Cell[m_capacity]),
+                m_enqueue_pos(0),
+                m_dequeue_pos(0)
+        {
+            for (size_t i = 0; i < m_capacity; ++i)
+            {
+                m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~RingQueue() {}
+
+    private:
+        RingQueue(const RingQueue &) = delete;
+
+        RingQueue &operator=(const RingQueue &) = delete;
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> m_sequence;
+            T m_data;
+        };
+
+        static size_t round_up_power_of_two(size_t value)
+        {
+            size_t result = 2;
+            while (result < value)
+            {
+                result <<= 1;
+            }
+
+            return result;
+        }
+
+    private:
+        const size_t m_capacity;
+        const size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+
+        /// 生产者与消费者位置分别独占缓存行，避免伪共享
+        char m_pad_0[64];
+        std::atomic<size_t> m_enqueue_pos;
+        char m_pad_1[64];
+        std::atomic<size_t> m_dequeue_pos;
+        char m_pad_2[64];
+
+    public:
+        /// 队列容量
+        inline size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        /// 近似元素个数，仅供统计
+        inline size_t size_approx() const
+        {
+            size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+        }
+
+        /// 入队，队列满时返回false
+        template<typename U>
+        bool try_push(U &&data)
+        {
+            Cell *cell = nullptr;
+            size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+            while (true)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->m_data = std::forward<U>(data);
+            cell->m_sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// 出队，队列空时返回false
+        bool try_pop(T &data)
+        {
+            Cell *cell = nullptr;
+            size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+            while (true)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->m_sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+
+            data = std::move(cell->m_data);
+            cell->m_data = T(); /// 及时释放槽位持有的资源
+            cell->m_sequence.store(pos + m_mask + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+}
+
+#endif
@@ -2,8 +2,20 @@
 #define __M_SEMPHORE_HPP_
 
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#else
 #include <mutex>
 #include <condition_variable>
+#endif
 
 namespace m_module_space
 {
@@ -12,13 +24,25 @@ namespace m_module_space
     {
         SEMPHORE_FAIL = (-1),
         SEMPHORE_SUCCESS = 0,
-        SEMPHORE_TIME_OUT = 1
+        SEMPHORE_TIME_OUT = 1,
+        SEMPHORE_INTERRUPT = 2
     };
 
+    /// 计数信号量：原子计数 + futex，先自旋后休眠，wait(size)原子地取走size个信号
     class Semphore
     {
     public:
-        Semphore(const int sigs = 0) : m_signals(sigs), m_blocked(0) {}
+        Semphore(const int sigs = 0) :
+                m_signals(sigs),
+                m_blocked(0),
+                m_batch_state(BATCH_STATE_EMPTY),
+                m_generation(0),
+                m_futex_seq(0),
+                m_batch_futex_seq(0),
+                m_spin_hint(SPIN_INIT_COUNT)
+        {
+
+        }
 
         ~Semphore() {}
 
@@ -30,79 +54,336 @@ namespace m_module_space
         Semphore operator=(const Semphore &) = delete;
 
     private:
+        enum
+        {
+            SPIN_INIT_COUNT = 64,
+            SPIN_MAX_COUNT = 2048
+        };
+
+        /// m_batch_state高32位为等待多个信号的线程数，低32位为其中最小的需求数，没有等待者时为UINT32_MAX
+        static const uint64_t BATCH_STATE_EMPTY = UINT32_MAX;
+
+        std::atomic<int> m_signals;
+        std::atomic<int> m_blocked; /// 等待单个信号的线程数
+        std::atomic<uint64_t> m_batch_state; /// 等待多个信号的线程另行登记，信号数够最小的需求时才唤醒
+        std::atomic<int> m_generation; /// interrupt()计数，等待期间变化则提前返回
+        std::atomic<int> m_futex_seq; /// 等待单个信号的线程休眠的字，信号或中断时递增
+        std::atomic<int> m_batch_futex_seq; /// 等待多个信号的线程休眠的字
+        std::atomic<int> m_spin_hint; /// 自适应自旋次数
+
+#if !defined(__linux__)
         std::mutex m_mtx;
         std::condition_variable m_cv;
-        int m_signals;
-        int m_blocked;
+#endif
 
-    public:
-        int wait(const int time_out_ms = (-1), const int size = 1)
+    private:
+        static inline void cpu_relax()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield" ::: "memory");
+#else
+            std::this_thread::yield();
+#endif
+        }
+
+        static inline bool single_core()
+        {
+            static const bool result = std::thread::hardware_concurrency() <= 1;
+            return result;
+        }
+
+        /// 尝试取走size个信号
+        inline bool try_acquire(const int size)
+        {
+            int cur = m_signals.load(std::memory_order_relaxed);
+            while (cur >= size)
+            {
+                if (m_signals.compare_exchange_weak(cur, cur - size))
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        /// 登记一个需要size个信号的等待线程
+        void add_batch_waiter(const int size)
+        {
+            uint64_t cur = m_batch_state.load();
+            uint64_t next;
+            do
+            {
+                const uint64_t need = cur & UINT32_MAX;
+                next = (((cur >> 32) + 1) << 32) | (static_cast<uint64_t>(size) < need ? static_cast<uint64_t>(size) : need);
+            } while (!m_batch_state.compare_exchange_weak(cur, next));
+        }
+
+        /// 注销等待线程；其他等待者的需求无法还原，最小需求保持不变直到全部注销，最多多唤醒几次
+        void remove_batch_waiter()
+        {
+            uint64_t cur = m_batch_state.load();
+            uint64_t next;
+            do
+            {
+                const uint64_t waiters = (cur >> 32) - 1;
+                next = waiters == 0 ? BATCH_STATE_EMPTY : ((waiters << 32) | (cur & UINT32_MAX));
+            } while (!m_batch_state.compare_exchange_weak(cur, next));
+        }
+
+        /// 信号数够最小的需求时唤醒全部多信号等待者，不够的再次休眠
+        inline void wake_batch_waiters()
+        {
+            const uint64_t state = m_batch_state.load();
+            if ((state >> 32) > 0 && static_cast<uint64_t>(m_signals.load()) >= (state & UINT32_MAX))
+            {
+                ++m_batch_futex_seq;
+                unpark(m_batch_futex_seq, INT_MAX);
+            }
+        }
+
+        /// word仍等于seq时休眠，time_out_ms小于0表示一直等待
+        void park(std::atomic<int> &word, const int seq, const long long time_out_ms)
         {
+#if defined(__linux__)
+            struct timespec ts;
+            struct timespec *p_ts = nullptr;
+
+            if (time_out_ms >= 0)
+            {
+                ts.tv_sec = static_cast<time_t>(time_out_ms / 1000);
+                ts.tv_nsec = static_cast<long>((time_out_ms % 1000) * 1000000);
+                p_ts = &ts;
+            }
+
+            syscall(SYS_futex, reinterpret_cast<int *>(&word), FUTEX_WAIT_PRIVATE, seq, p_ts, nullptr, 0);
+#else
             std::unique_lock<std::mutex> ul(m_mtx);
+            auto changed = [&] { return word.load() != seq; };
 
-            if (m_signals >= size)
+            if (time_out_ms >= 0)
             {
-                return SEMPHORE_SUCCESS;
+                m_cv.wait_for(ul, std::chrono::milliseconds(time_out_ms), changed);
             }
             else
             {
-                ++m_blocked;
+                m_cv.wait(ul, changed);
             }
+#endif
+        }
 
-            if (time_out_ms >= 0)
+        /// 唤醒至多count个在word上休眠的线程
+        void unpark(std::atomic<int> &word, const int count)
+        {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<int *>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+#else
+            std::lock_guard<std::mutex> lg(m_mtx);
+
+            /// 两种等待者共用一个条件变量
+            if (count == 1 && m_batch_state.load() == BATCH_STATE_EMPTY)
+            {
+                m_cv.notify_one();
+            }
+            else
             {
-                std::chrono::milliseconds wait_time_ms(time_out_ms);
-                auto result = m_cv.wait_for(ul, wait_time_ms, [&] { return m_signals >= size; });
-                --m_blocked;
+                m_cv.notify_all();
+            }
+#endif
+        }
 
-                if (result)
-                {
-                    return SEMPHORE_SUCCESS;
-                }
-                else
+        /// 自旋等待，成功后调整自旋次数
+        bool spin_acquire(const int size)
+        {
+            if (single_core())
+            {
+                return false;
+            }
+
+            int hint = m_spin_hint.load(std::memory_order_relaxed);
+            int limit = hint * 2 + 16 < SPIN_MAX_COUNT ? hint * 2 + 16 : SPIN_MAX_COUNT;
+
+            for (int i = 0; i < limit; ++i)
+            {
+                if (m_signals.load(std::memory_order_relaxed) >= size && try_acquire(size))
                 {
-                    return SEMPHORE_TIME_OUT;
+                    m_spin_hint.store(hint + (i - hint) / 8, std::memory_order_relaxed);
+                    return true;
                 }
+
+                cpu_relax();
             }
-            else
+
+            /// 自旋失败，减少下次自旋次数
+            m_spin_hint.store(hint - hint / 8, std::memory_order_relaxed);
+            return false;
+        }
+
+    public:
+        /// 只尝试一次取走size个信号，不自旋也不休眠，取不到返回SEMPHORE_TIME_OUT
+        inline int try_wait(const int size = 1)
+        {
+            return try_acquire(size) ? SEMPHORE_SUCCESS : SEMPHORE_TIME_OUT;
+        }
+
+        int wait(const int time_out_ms = (-1), const int size = 1)
+        {
+            if (try_acquire(size) || spin_acquire(size))
             {
-                m_cv.wait(ul, [&] { return m_signals >= size; });
-                --m_blocked;
                 return SEMPHORE_SUCCESS;
             }
+
+            const int generation = m_generation.load();
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(time_out_ms);
+
+            while (true)
+            {
+                long long remain_ms = -1;
+                if (time_out_ms >= 0)
+                {
+                    remain_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+
+                    if (remain_ms <= 0)
+                    {
+                        return try_acquire(size) ? SEMPHORE_SUCCESS : SEMPHORE_TIME_OUT;
+                    }
+                }
+
+                std::atomic<int> &word = size > 1 ? m_batch_futex_seq : m_futex_seq;
+                const int seq = word.load();
+                if (size > 1)
+                {
+                    add_batch_waiter(size);
+                }
+                else
+                {
+                    ++m_blocked;
+                }
+
+                /// 登记之后再检查一次，避免错过signal()
+                int result = SEMPHORE_FAIL;
+                if (try_acquire(size))
+                {
+                    result = SEMPHORE_SUCCESS;
+                }
+                else if (m_generation.load() != generation)
+                {
+                    result = SEMPHORE_INTERRUPT;
+                }
+                else
+                {
+                    park(word, seq, remain_ms);
+                }
+
+                if (size > 1)
+                {
+                    remove_batch_waiter();
+                }
+                else
+                {
+                    --m_blocked;
+                }
+
+                if (result != SEMPHORE_FAIL)
+                {
+                    return result;
+                }
+
+                if (try_acquire(size))
+                {
+                    return SEMPHORE_SUCCESS;
+                }
+
+                if (m_generation.load() != generation)
+                {
+                    return SEMPHORE_INTERRUPT;
+                }
+            }
         }
 
-        inline void signal(const int count = 1)
+        /// 增加count个信号，等待单个信号的线程只唤醒能被满足的数量，
+        /// 等待多个信号的线程只在信号数够其中最小的需求时唤醒
+        /// max_wake限制唤醒的单信号等待线程数，用于等待者一次会取走多个信号的场景，未被唤醒的由取到信号的线程用wake()接力
+        inline void signal(const int count = 1, const int max_wake = INT_MAX)
         {
-            std::lock_guard<std::mutex> lg(m_mtx);
+            if (count <= 0)
+            {
+                return;
+            }
 
             m_signals += count;
-            if (m_blocked > 0)
+
+            int blocked = m_blocked.load();
+            if (blocked > 0)
             {
-                int notify_count = m_blocked < count ? m_blocked : count;
-                for (int i = 0; i < notify_count; ++i)
+                int wake_count = blocked < count ? blocked : count;
+                if (wake_count > max_wake)
                 {
-                    m_cv.notify_one();
+                    wake_count = max_wake > 0 ? max_wake : 1;
                 }
+
+                ++m_futex_seq;
+                unpark(m_futex_seq, wake_count);
             }
+
+            wake_batch_waiters();
         }
 
-        inline void unsignal(const int count = 1)
+        /// 仍有信号时唤醒至多count个等待单个信号的线程，不改变信号数；多信号等待者按需求唤醒
+        inline void wake(const int count = 1)
         {
-            std::lock_guard<std::mutex> lg(m_mtx);
+            if (m_blocked.load() > 0 && m_signals.load() > 0)
+            {
+                ++m_futex_seq;
+                unpark(m_futex_seq, count);
+            }
 
-            if (m_signals >= count)
+            wake_batch_waiters();
+        }
+
+        /// 唤醒所有正在等待的线程，使其返回SEMPHORE_INTERRUPT，不改变信号数
+        inline void interrupt()
+        {
+            ++m_generation;
+
+            if (m_blocked.load() > 0)
             {
-                m_signals -= count;
+                ++m_futex_seq;
+                unpark(m_futex_seq, INT_MAX);
             }
-            else
+
+            if (m_batch_state.load() != BATCH_STATE_EMPTY)
             {
-                m_signals = 0;
+                ++m_batch_futex_seq;
+                unpark(m_batch_futex_seq, INT_MAX);
             }
         }
 
+        /// 取走至多count个信号，不阻塞
+        inline void unsignal(const int count = 1)
+        {
+            int cur = m_signals.load(std::memory_order_relaxed);
+            while (cur > 0)
+            {
+                int next = cur > count ? cur - count : 0;
+                if (m_signals.compare_exchange_weak(cur, next))
+                {
+                    return;
+                }
+            }
+        }
+
+        /// 当前信号数
+        inline int count() const
+        {
+            return m_signals.load(std::memory_order_relaxed);
+        }
+
     };
 
 }
 
-#endif
\ No newline at end of file
+#endif
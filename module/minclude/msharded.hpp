@@ -0,0 +1,379 @@
+#ifndef __M_SHARDED_HPP_
+#define __M_SHARDED_HPP_
+
+#include <vector>
+#include <list>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include "mprocessor.hpp"
+
+namespace m_module_space
+{
+
+    /// 按键分片的流水线单元：每个分片拥有独立的任务队列和唯一的工作线程，
+    /// 同一键的任务总是进入同一分片并按投递顺序处理，不同分片之间没有共享锁
+    /// 子类实现task_key()与handle_task()；队列、溢出、批量等设置须在begin_thread之前完成，创建分片时复制到每个分片
+    template<typename T>
+    class ShardedProcessor : public Processor<T>
+    {
+    public:
+        ShardedProcessor() {}
+
+        virtual ~ShardedProcessor() { end_all_threads(); }
+
+    private:
+        ShardedProcessor(const ShardedProcessor &) = delete;
+
+        ShardedProcessor &operator=(const ShardedProcessor &) = delete;
+
+    private:
+        /// 分片：单线程的Processor，处理与传递都交给所属的ShardedProcessor
+        class ShardUnit : public Processor<T>
+        {
+        public:
+            ShardUnit(ShardedProcessor<T> *p_owner, const int index) : m_p_owner(p_owner)
+            {
+                this->m_task_max_count = p_owner->m_task_max_count;
+                this->m_thread_timeout_ms = p_owner->m_thread_timeout_ms;
+                this->m_metrics_timing_flag = p_owner->m_metrics_timing_flag;
+                this->m_thread_placement = p_owner->m_thread_placement;
+                this->m_thread_seq = index; /// THREAD_PIN_SPREAD时各分片分散到不同核心
+                this->set_processor_id(p_owner->m_processor_id);
+                this->set_processor_name(p_owner->m_processor_name + "#" + std::to_string(index));
+                this->set_queue_mode(p_owner->m_queue_mode);
+                this->set_schedule_mode(p_owner->m_schedule_mode);
+                this->set_idle_mode(p_owner->m_idle_mode);
+                this->set_overflow_policy(p_owner->m_overflow_policy, p_owner->m_overflow_wait_ms);
+                this->set_batch_policy(p_owner->m_batch_number, p_owner->m_batch_linger_ms,
+                                       p_owner->m_batch_min_number);
+            }
+
+            virtual ~ShardUnit() { this->end_all_threads(); }
+
+        private:
+            ShardedProcessor<T> *m_p_owner;
+
+        protected:
+            virtual void handle_task(std::list<std::shared_ptr<T>> &tasks)
+            {
+                m_p_owner->handle_task(tasks);
+            }
+
+            virtual void fan_out(std::list<std::shared_ptr<T>> &tasks)
+            {
+                m_p_owner->fan_out(tasks);
+            }
+
+            virtual void report_queue_full()
+            {
+                m_p_owner->report_queue_full();
+            }
+
+            virtual void report_queue_changed_to_not_full()
+            {
+                m_p_owner->report_queue_changed_to_not_full();
+            }
+
+            virtual void handle_timeout()
+            {
+                m_p_owner->handle_timeout();
+            }
+
+            virtual void report_task_dropped(std::list<std::shared_ptr<T>> &tasks)
+            {
+                m_p_owner->report_task_dropped(tasks);
+            }
+
+            virtual void report_task_expired(std::list<std::shared_ptr<T>> &tasks)
+            {
+                m_p_owner->report_task_expired(tasks);
+            }
+
+            virtual void classify_task(const std::shared_ptr<T> &sp_task, int &priority, int64_t &deadline_ns)
+            {
+                m_p_owner->classify_task(sp_task, priority, deadline_ns);
+            }
+
+        public:
+            /// 线程数量
+            inline int thread_count()
+            {
+                std::lock_guard<std::mutex> auto_lock(this->m_thread_lock);
+                return static_cast<int>(this->m_thread_list.size());
+            }
+        };
+
+        std::vector<std::unique_ptr<ShardUnit>> m_shards;
+        std::atomic<int> m_shard_count{0}; /// 分片创建完成后才发布，投递时不加锁读取m_shards
+
+    protected:
+        /// 任务的分片键，例如流id；同一键的任务保持顺序
+        virtual uint64_t task_key(const std::shared_ptr<T> &sp_task) = 0;
+
+    private:
+        inline size_t shard_index(const std::shared_ptr<T> &sp_task, const int shard_count)
+        {
+            /// 打散连续的键
+            uint64_t key = task_key(sp_task);
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            return static_cast<size_t>(key % static_cast<uint64_t>(shard_count));
+        }
+
+        /// 把[first, last)按键分组投递到各分片，同一分片的任务保持原有顺序
+        template<typename Iterator>
+        int push_grouped(Iterator first, Iterator last, const int shard_count, int *p_new_size,
+                         const int wait_time_on_queue_full)
+        {
+            /// 每个分片一个批次，批次从池中分配；分组数组线程内复用，先换出再使用
+            static thread_local std::vector<std::shared_ptr<TaskBatch<T>>> s_groups;
+            std::vector<std::shared_ptr<TaskBatch<T>>> groups;
+            groups.swap(s_groups);
+            groups.resize(static_cast<size_t>(shard_count));
+
+            for (; first != last; ++first)
+            {
+                std::shared_ptr<TaskBatch<T>> &sp_group = groups[shard_index(*first, shard_count)];
+                if (sp_group == nullptr)
+                {
+                    sp_group = make_task_batch<T>();
+                }
+
+                sp_group->push_back(*first);
+            }
+
+            int result = PROCESSOR_SUCCESS;
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                if (groups[i] == nullptr)
+                {
+                    continue;
+                }
+
+                int shard_result = m_shards[i]->push_batch(groups[i], p_new_size, wait_time_on_queue_full);
+                if (shard_result != PROCESSOR_SUCCESS)
+                {
+                    result = shard_result;
+                }
+
+                groups[i].reset();
+            }
+
+            groups.swap(s_groups);
+            return result;
+        }
+
+    public:
+        /// 第一次调用时创建count个分片，每个分片一个线程；之后的调用只重启已结束的分片线程
+        virtual int begin_thread(const int count = 1)
+        {
+            std::lock_guard<std::mutex> auto_lock(this->m_thread_lock);
+
+            if (m_shard_count.load() == 0)
+            {
+                if (count <= 0 || count > this->m_thread_max_count)
+                {
+                    return 0;
+                }
+
+                try
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        m_shards.emplace_back(new ShardUnit(this, i));
+                    }
+                }
+                catch (...)
+                {
+                    m_shards.clear();
+                    return 0;
+                }
+
+                m_shard_count.store(count);
+            }
+
+            this->m_drained_upstreams.store(0);
+            this->m_accepting.store(1);
+
+            int create_count = 0;
+            for (auto &sp_shard : m_shards)
+            {
+                if (sp_shard->thread_count() == 0)
+                {
+                    create_count += sp_shard->begin_thread(1);
+                }
+            }
+
+            /// 分片与所属单元使用同一个id，跟踪导出时显示所属单元的名字
+            if (!this->m_processor_name.empty())
+            {
+                Tracer::instance().set_processor_name(this->m_processor_id, this->m_processor_name);
+            }
+
+            return create_count;
+        }
+
+        virtual void end_all_threads(bool sync = true)
+        {
+            std::lock_guard<std::mutex> auto_lock(this->m_thread_lock);
+
+            for (auto &sp_shard : m_shards)
+            {
+                sp_shard->end_all_threads(sync);
+            }
+        }
+
+        virtual void stop_intake()
+        {
+            Processor<T>::stop_intake();
+
+            const int shard_count = m_shard_count.load();
+            for (int i = 0; i < shard_count; ++i)
+            {
+                m_shards[i]->stop_intake();
+            }
+        }
+
+        virtual void resume_intake()
+        {
+            Processor<T>::resume_intake();
+
+            const int shard_count = m_shard_count.load();
+            for (int i = 0; i < shard_count; ++i)
+            {
+                m_shards[i]->resume_intake();
+            }
+        }
+
+        /// 分片数量
+        inline int get_shard_count() const
+        {
+            return m_shard_count.load();
+        }
+
+        virtual bool is_idle() const
+        {
+            const int shard_count = m_shard_count.load();
+            for (int i = 0; i < shard_count; ++i)
+            {
+                if (!m_shards[i]->is_idle())
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        /// 汇总所有分片的统计
+        virtual void get_stats(ProcessorStats &stats)
+        {
+            stats = ProcessorStats();
+            stats.m_processor_id = this->m_processor_id;
+            stats.m_processor_name = this->m_processor_name;
+
+            const int shard_count = m_shard_count.load();
+            for (int i = 0; i < shard_count; ++i)
+            {
+                ProcessorStats shard_stats;
+                m_shards[i]->get_stats(shard_stats);
+
+                stats.m_enqueued += shard_stats.m_enqueued;
+                stats.m_dequeued += shard_stats.m_dequeued;
+                stats.m_dropped += shard_stats.m_dropped;
+                stats.m_expired += shard_stats.m_expired;
+                stats.m_queue_depth += shard_stats.m_queue_depth;
+                stats.m_spill_size += shard_stats.m_spill_size;
+                stats.m_queue_high_water = stats.m_queue_high_water > shard_stats.m_queue_high_water
+                                           ? stats.m_queue_high_water : shard_stats.m_queue_high_water;
+                stats.m_batch_size.merge(shard_stats.m_batch_size);
+                stats.m_queue_time_ns.merge(shard_stats.m_queue_time_ns);
+                stats.m_handle_time_ns.merge(shard_stats.m_handle_time_ns);
+            }
+        }
+
+        /// 读取单个分片的统计
+        int get_shard_stats(const int index, ProcessorStats &stats)
+        {
+            if (index < 0 || index >= m_shard_count.load())
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            m_shards[index]->get_stats(stats);
+            return PROCESSOR_SUCCESS;
+        }
+
+        /// 按键拆分后投递到各分片，同一分片的任务保持原有顺序；p_new_size为最后投递的分片的任务数
+        /// 任一分片拒收返回该分片的结果，其他分片已接收的任务不撤回
+        virtual int
+        push_task(std::list<std::shared_ptr<T>> &task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            const int shard_count = m_shard_count.load();
+            if (task.empty() || shard_count == 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            return push_grouped(task.begin(), task.end(), shard_count, p_new_size, wait_time_on_queue_full);
+        }
+
+        virtual int push_task(std::shared_ptr<T> &sp_task, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            const int shard_count = m_shard_count.load();
+            if (sp_task == nullptr || shard_count == 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            return m_shards[shard_index(sp_task, shard_count)]->push_task(sp_task, p_new_size, wait_time_on_queue_full);
+        }
+
+        virtual int push_priority_task(std::shared_ptr<T> &sp_task, const int priority, const int64_t deadline_ns = 0,
+                                       int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            const int shard_count = m_shard_count.load();
+            if (sp_task == nullptr || shard_count == 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            return m_shards[shard_index(sp_task, shard_count)]->push_priority_task(sp_task, priority, deadline_ns,
+                                                                                  p_new_size,
+                                                                                  wait_time_on_queue_full);
+        }
+
+        /// 整批属于同一分片时直接共享批次，否则按键拆分，与push_task(list)一样不逐个分配
+        virtual int
+        push_batch(const SP_TASK_BATCH<T> &sp_batch, int *p_new_size = nullptr, int wait_time_on_queue_full = 0)
+        {
+            const int shard_count = m_shard_count.load();
+            if (sp_batch == nullptr || sp_batch->empty() || shard_count == 0)
+            {
+                return PROCESSOR_FAIL;
+            }
+
+            size_t first_index = shard_index(sp_batch->front(), shard_count);
+            bool same_shard = true;
+
+            for (size_t i = 1; i < sp_batch->size() && same_shard; ++i)
+            {
+                same_shard = shard_index((*sp_batch)[i], shard_count) == first_index;
+            }
+
+            if (same_shard)
+            {
+                return m_shards[first_index]->push_batch(sp_batch, p_new_size, wait_time_on_queue_full);
+            }
+
+            return push_grouped(sp_batch->begin(), sp_batch->end(), shard_count, p_new_size, wait_time_on_queue_full);
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef __M_THREAD_HPP_
+#define __M_THREAD_HPP_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+namespace m_module_space
+{
+
+    /// 核心分配方式
+    enum
+    {
+        THREAD_PIN_SET = 0,   /// 每个线程可在整个核心集合上运行
+        THREAD_PIN_SPREAD = 1 /// 第i个线程固定在第i % n个核心上
+    };
+
+    /// 线程放置：核心集合、NUMA节点、调度策略及线程名
+    struct ThreadPlacement
+    {
+        std::vector<int> m_cpus;       /// 为空且m_numa_node >= 0时使用该节点的全部核心
+        int m_pin_mode = THREAD_PIN_SET;
+        int m_numa_node = (-1);        /// 小于0表示不绑定节点；绑定时内存优先从该节点分配
+        int m_sched_policy = (-1);     /// SCHED_OTHER、SCHED_BATCH、SCHED_IDLE、SCHED_FIFO、SCHED_RR，小于0表示不修改
+        int m_sched_priority = 0;      /// SCHED_FIFO、SCHED_RR的优先级
+        bool m_set_name = true;        /// 按单元名为线程命名
+    };
+
+    /// 解析形如"0-3,8,10-11"的核心列表
+    static inline bool parse_cpu_list(const std::string &text, std::vector<int> &cpus)
+    {
+        std::stringstream ss(text);
+        std::string item;
+
+        while (std::getline(ss, item, ','))
+        {
+            if (item.empty() || item == "\n")
+            {
+                continue;
+            }
+
+            char *p_end = nullptr;
+            long first = std::strtol(item.c_str(), &p_end, 10);
+            long last = first;
+
+            if (p_end == item.c_str())
+            {
+                return false;
+            }
+
+            if (*p_end == '-')
+            {
+                last = std::strtol(p_end + 1, &p_end, 10);
+            }
+
+            if (first < 0 || last < first)
+            {
+                return false;
+            }
+
+            for (long cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(static_cast<int>(cpu));
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    /// 读取NUMA节点的核心列表，节点不存在返回false
+    static inline bool numa_node_cpus(const int node, std::vector<int> &cpus)
+    {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string text;
+
+        if (!in.is_open() || !std::getline(in, text))
+        {
+            return false;
+        }
+
+        return parse_cpu_list(text, cpus);
+    }
+
+    /// 检查放置配置是否可用
+    static inline bool check_thread_placement(const ThreadPlacement &placement)
+    {
+#if defined(__linux__)
+        for (auto cpu : placement.m_cpus)
+        {
+            if (cpu < 0 || cpu >= CPU_SETSIZE)
+            {
+                return false;
+            }
+        }
+
+        std::vector<int> node_cpus;
+        if (placement.m_numa_node >= 0 && !numa_node_cpus(placement.m_numa_node, node_cpus))
+        {
+            return false;
+        }
+
+        if (placement.m_sched_policy >= 0)
+        {
+            int min_priority = sched_get_priority_min(placement.m_sched_policy);
+            int max_priority = sched_get_priority_max(placement.m_sched_policy);
+            if (min_priority < 0 || placement.m_sched_priority < min_priority ||
+                placement.m_sched_priority > max_priority)
+            {
+                return false;
+            }
+        }
+
+        return true;
+#else
+        return placement.m_cpus.empty() && placement.m_numa_node < 0 && placement.m_sched_policy < 0;
+#endif
+    }
+
+    /// 设置当前线程名，超过15个字节时截断
+    static inline void set_current_thread_name(const std::string &name)
+    {
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+    }
+
+    /// 把放置配置应用到当前线程，index为线程序号，全部成功返回true；
+    /// 权限不足等失败不影响线程运行
+    static inline bool apply_thread_placement(const ThreadPlacement &placement, const int index)
+    {
+        bool result = true;
+
+#if defined(__linux__)
+        std::vector<int> cpus(placement.m_cpus);
+        if (cpus.empty() && placement.m_numa_node >= 0)
+        {
+            numa_node_cpus(placement.m_numa_node, cpus);
+        }
+
+        if (!cpus.empty())
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+
+            if (placement.m_pin_mode == THREAD_PIN_SPREAD)
+            {
+                CPU_SET(cpus[static_cast<size_t>(index) % cpus.size()], &cpu_set);
+            }
+            else
+            {
+                for (auto cpu : cpus)
+                {
+                    CPU_SET(cpu, &cpu_set);
+                }
+            }
+
+            result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0 && result;
+        }
+
+        /// 之后本线程分配的内存优先来自该节点，节点内存不足时仍可使用其他节点
+        if (placement.m_numa_node >= 0)
+        {
+            const unsigned long bits = sizeof(unsigned long) * 8;
+            std::vector<unsigned long> node_mask(static_cast<size_t>(placement.m_numa_node) / bits + 1, 0);
+            node_mask[static_cast<size_t>(placement.m_numa_node) / bits] |= 1UL << (placement.m_numa_node % bits);
+
+            result = syscall(SYS_set_mempolicy, MPOL_PREFERRED, node_mask.data(), node_mask.size() * bits + 1) == 0 &&
+                     result;
+        }
+
+        if (placement.m_sched_policy >= 0)
+        {
+            struct sched_param param;
+            param.sched_priority = placement.m_sched_priority;
+            result = pthread_setschedparam(pthread_self(), placement.m_sched_policy, &param) == 0 && result;
+        }
+#endif
+
+        return result;
+    }
+
+}
+
+#endif
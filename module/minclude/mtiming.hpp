@@ -0,0 +1,205 @@
+#ifndef __M_TIMING_HPP_
+#define __M_TIMING_HPP_
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <utility>
+#include <functional>
+
+#include "mevent.hpp"
+#include "mthread.hpp"
+#include "mmetrics.hpp"
+#include "mhistogram.hpp"
+#include "StopWatch.h"
+
+/// 统计所在作用域的耗时，记入计时表中名为name的直方图，单位纳秒
+/// 名称只在第一次执行到该处时查找一次，之后每次只有两次读时钟和一次直方图记录
+#define timing_scope(name) timing_scope_at(name, __LINE__)
+#define timing_scope_at(name, line) timing_scope_impl(name, line)
+#define timing_scope_impl(name, line) \
+    static m_module_space::LatencyHistogram &s_timing_histogram_##line = \
+            m_module_space::TimingRegistry::instance().histogram(name); \
+    m_module_space::ScopedTimer scoped_timer_##line(s_timing_histogram_##line)
+
+namespace m_module_space
+{
+
+    /// 离开作用域时把耗时记入直方图
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(LatencyHistogram &histogram) : m_histogram(histogram) {}
+
+        ~ScopedTimer()
+        {
+            m_watch.RecordNs(m_histogram);
+        }
+
+    private:
+        ScopedTimer(const ScopedTimer &) = delete;
+
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        LatencyHistogram &m_histogram;
+        TscStopWatch m_watch;
+    };
+
+    /// 进程内按名称登记的耗时直方图，登记后不删除，返回的引用一直有效
+    class TimingRegistry
+    {
+    public:
+        static TimingRegistry &instance()
+        {
+            static TimingRegistry s_registry;
+            return s_registry;
+        }
+
+        ~TimingRegistry()
+        {
+            stop_report();
+        }
+
+    private:
+        TimingRegistry() {}
+
+        TimingRegistry(const TimingRegistry &) = delete;
+
+        TimingRegistry &operator=(const TimingRegistry &) = delete;
+
+    private:
+        std::mutex m_lock;
+        std::map<std::string, std::unique_ptr<LatencyHistogram>> m_histograms;
+
+        std::mutex m_report_lock;
+        std::shared_ptr<std::thread> m_sp_report_thread;
+        Event m_report_quit_event;
+
+    public:
+        /// 查找或登记名为name的直方图，precision_bits只在第一次登记时生效
+        LatencyHistogram &histogram(const std::string &name,
+                                    const int precision_bits = HISTOGRAM_DEFAULT_PRECISION_BITS)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+
+            std::unique_ptr<LatencyHistogram> &sp_histogram = m_histograms[name];
+            if (sp_histogram == nullptr)
+            {
+                sp_histogram.reset(new LatencyHistogram(precision_bits));
+            }
+
+            return *sp_histogram;
+        }
+
+        /// 按名称顺序取所有直方图的快照，reset为true时取完清零
+        void collect(std::vector<std::pair<std::string, LatencySnapshot>> &snapshots, const bool reset = false)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+
+            snapshots.clear();
+            snapshots.reserve(m_histograms.size());
+            for (auto &cur : m_histograms)
+            {
+                snapshots.emplace_back(cur.first, LatencySnapshot());
+                cur.second->collect(snapshots.back().second);
+
+                if (reset)
+                {
+                    cur.second->reset();
+                }
+            }
+        }
+
+        /// 每个直方图输出一行JSON，没有记录的直方图不输出
+        std::string dump(const bool reset = false)
+        {
+            std::vector<std::pair<std::string, LatencySnapshot>> snapshots;
+            collect(snapshots, reset);
+
+            std::string out;
+            for (auto &cur : snapshots)
+            {
+                if (cur.second.m_count == 0)
+                {
+                    continue;
+                }
+
+                out += "{\"name\":\"" + metrics_json_escape(cur.first) + "\",\"unit\":\"ns\",";
+                out += cur.second.to_json().substr(1);
+                out += "\n";
+            }
+
+            return out;
+        }
+
+        void reset()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+
+            for (auto &cur : m_histograms)
+            {
+                cur.second->reset();
+            }
+        }
+
+        /// 每interval_ms把dump(reset)的结果交给report，正在输出时先停止原来的输出线程
+        bool start_report(const int interval_ms, const std::function<void(const std::string &)> &report,
+                         const bool reset = true)
+        {
+            if (interval_ms <= 0 || !report)
+            {
+                return false;
+            }
+
+            stop_report();
+
+            std::lock_guard<std::mutex> auto_lock(m_report_lock);
+            m_report_quit_event.reset();
+
+            try
+            {
+                m_sp_report_thread = std::make_shared<std::thread>([this, interval_ms, report, reset]() -> void {
+                    set_current_thread_name("timing_report");
+
+                    while (this->m_report_quit_event.wait(interval_ms) == EVENT_TIME_OUT)
+                    {
+                        std::string text(this->dump(reset));
+                        if (!text.empty())
+                        {
+                            report(text);
+                        }
+                    }
+                });
+            }
+            catch (...)
+            {
+                m_sp_report_thread.reset();
+                return false;
+            }
+
+            return true;
+        }
+
+        void stop_report()
+        {
+            std::shared_ptr<std::thread> sp_report_thread;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_report_lock);
+                sp_report_thread.swap(m_sp_report_thread);
+            }
+
+            if (sp_report_thread != nullptr && sp_report_thread->joinable())
+            {
+                m_report_quit_event.set();
+                sp_report_thread->join();
+            }
+        }
+    };
+
+}
+
+#endif
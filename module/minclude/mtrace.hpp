@@ -0,0 +1,556 @@
+#ifndef __M_TRACE_HPP_
+#define __M_TRACE_HPP_
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include "mmetrics.hpp"
+
+namespace m_module_space
+{
+
+    enum
+    {
+        TRACE_RING_CAPACITY = 8192, /// 默认每个线程保留的记录数，向上取整为2的幂
+        TRACE_PENDING_LIMIT = 64    /// 一次取任务最多跟踪的采样任务数
+    };
+
+    /// 记录类型
+    enum
+    {
+        TRACE_PUSH = 0,   /// 投递，瞬时事件
+        TRACE_QUEUE = 1,  /// 从投递到被工作线程取出
+        TRACE_HANDLE = 2, /// handle_task
+        TRACE_FAN_OUT = 3 /// fan_out
+    };
+
+    /// 导出用的记录
+    struct TraceRecord
+    {
+        uint64_t m_trace_id = 0;
+        int64_t m_begin_ns = 0;
+        int64_t m_end_ns = 0;
+        int m_processor_id = 0;
+        int m_kind = TRACE_PUSH;
+        int m_thread_index = 0;
+    };
+
+    /// 单线程写入的环形记录缓冲，写满后覆盖最旧的记录；导出线程可并发读取
+    class TraceRing
+    {
+    public:
+        TraceRing(const size_t capacity, const int thread_index) :
+                m_capacity(round_up_power_of_two(capacity)),
+                m_mask(m_capacity - 1),
+                m_slots(new Slot[m_capacity]),
+                m_write_index(0),
+                m_thread_index(thread_index),
+                m_in_use(true)
+        {
+
+        }
+
+    private:
+        TraceRing(const TraceRing &) = delete;
+
+        TraceRing &operator=(const TraceRing &) = delete;
+
+    private:
+        /// 各字段用relaxed原子读写，导出时按写入序号丢弃读取期间被覆盖的记录
+        struct Slot
+        {
+            std::atomic<uint64_t> m_trace_id{0};
+            std::atomic<int64_t> m_begin_ns{0};
+            std::atomic<int64_t> m_end_ns{0};
+            std::atomic<int> m_processor_id{0};
+            std::atomic<int> m_kind{0};
+        };
+
+        static size_t round_up_power_of_two(size_t value)
+        {
+            size_t result = 2;
+            while (result < value)
+            {
+                result <<= 1;
+            }
+
+            return result;
+        }
+
+        const size_t m_capacity;
+        const size_t m_mask;
+        std::unique_ptr<Slot[]> m_slots;
+        std::atomic<uint64_t> m_write_index;
+
+    public:
+        const int m_thread_index;
+        std::string m_thread_name;
+        std::atomic<bool> m_in_use; /// 所属线程退出后可被新线程复用
+
+    public:
+        inline void record(const uint64_t trace_id, const int kind, const int processor_id, const int64_t begin_ns,
+                           const int64_t end_ns)
+        {
+            const uint64_t index = m_write_index.load(std::memory_order_relaxed);
+            Slot &slot = m_slots[index & m_mask];
+
+            slot.m_trace_id.store(trace_id, std::memory_order_relaxed);
+            slot.m_begin_ns.store(begin_ns, std::memory_order_relaxed);
+            slot.m_end_ns.store(end_ns, std::memory_order_relaxed);
+            slot.m_processor_id.store(processor_id, std::memory_order_relaxed);
+            slot.m_kind.store(kind, std::memory_order_relaxed);
+
+            m_write_index.store(index + 1, std::memory_order_release);
+        }
+
+        /// 追加当前保留的记录
+        void collect(std::vector<TraceRecord> &records) const
+        {
+            const uint64_t end = m_write_index.load(std::memory_order_acquire);
+            const uint64_t begin = end > m_capacity ? end - m_capacity : 0;
+            const size_t old_size = records.size();
+
+            for (uint64_t index = begin; index < end; ++index)
+            {
+                const Slot &slot = m_slots[index & m_mask];
+
+                TraceRecord record;
+                record.m_trace_id = slot.m_trace_id.load(std::memory_order_relaxed);
+                record.m_begin_ns = slot.m_begin_ns.load(std::memory_order_relaxed);
+                record.m_end_ns = slot.m_end_ns.load(std::memory_order_relaxed);
+                record.m_processor_id = slot.m_processor_id.load(std::memory_order_relaxed);
+                record.m_kind = slot.m_kind.load(std::memory_order_relaxed);
+                record.m_thread_index = m_thread_index;
+                records.push_back(record);
+            }
+
+            /// 读取期间写入线程追上来的部分可能已被覆盖
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t after = m_write_index.load(std::memory_order_relaxed);
+            if (after > begin + m_capacity)
+            {
+                const size_t overwritten = static_cast<size_t>(std::min<uint64_t>(after - begin - m_capacity,
+                                                                                   end - begin));
+                records.erase(records.begin() + static_cast<long>(old_size),
+                              records.begin() + static_cast<long>(old_size + overwritten));
+            }
+        }
+
+        void clear()
+        {
+            m_write_index.store(0, std::memory_order_release);
+        }
+    };
+
+    /// 流水线跟踪：投递时按1/N采样并分配跟踪号，下游投递继承当前线程正在处理的跟踪号，
+    /// 记录写入各线程的环形缓冲，导出为Chrome trace event JSON（chrome://tracing、Perfetto）
+    /// 未开启时热路径只有一次relaxed读取
+    class Tracer
+    {
+    public:
+        static Tracer &instance()
+        {
+            static Tracer s_tracer;
+            return s_tracer;
+        }
+
+    private:
+        Tracer() :
+                m_enabled(false),
+                m_sample_every(1),
+                m_ring_capacity(TRACE_RING_CAPACITY),
+                m_next_trace_id(1)
+        {
+
+        }
+
+        Tracer(const Tracer &) = delete;
+
+        Tracer &operator=(const Tracer &) = delete;
+
+    private:
+        /// 当前线程的环形缓冲，线程退出时交还
+        struct LocalRing
+        {
+            std::shared_ptr<TraceRing> m_sp_ring;
+
+            ~LocalRing()
+            {
+                if (m_sp_ring != nullptr)
+                {
+                    m_sp_ring->m_in_use.store(false);
+                }
+            }
+        };
+
+        /// 当前线程取出的采样任务：跟踪号与投递时间
+        struct PendingTrace
+        {
+            uint64_t m_trace_id;
+            int64_t m_push_ns;
+        };
+
+        std::atomic<bool> m_enabled;
+        std::atomic<int> m_sample_every;
+        std::atomic<int> m_ring_capacity;
+        std::atomic<uint64_t> m_next_trace_id;
+
+        std::mutex m_lock;
+        std::vector<std::shared_ptr<TraceRing>> m_rings;
+        std::map<int, std::string> m_processor_names;
+
+        static inline LocalRing &local_ring()
+        {
+            static thread_local LocalRing s_ring;
+            return s_ring;
+        }
+
+        static inline std::vector<PendingTrace> &pending()
+        {
+            static thread_local std::vector<PendingTrace> s_pending;
+            return s_pending;
+        }
+
+        static inline uint64_t &current_trace()
+        {
+            static thread_local uint64_t s_trace_id = 0;
+            return s_trace_id;
+        }
+
+        static inline bool &worker_thread()
+        {
+            static thread_local bool s_worker = false;
+            return s_worker;
+        }
+
+        TraceRing &ring()
+        {
+            LocalRing &local = local_ring();
+            if (local.m_sp_ring != nullptr)
+            {
+                return *local.m_sp_ring;
+            }
+
+            std::string thread_name;
+#if defined(__linux__)
+            char name[16] = {};
+            if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0)
+            {
+                thread_name = name;
+            }
+#endif
+
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+
+            for (auto &sp_ring : m_rings)
+            {
+                bool in_use = false;
+                if (sp_ring->m_in_use.compare_exchange_strong(in_use, true))
+                {
+                    local.m_sp_ring = sp_ring;
+                    break;
+                }
+            }
+
+            if (local.m_sp_ring == nullptr)
+            {
+                local.m_sp_ring = std::make_shared<TraceRing>(static_cast<size_t>(m_ring_capacity.load()),
+                                                              static_cast<int>(m_rings.size()));
+                m_rings.push_back(local.m_sp_ring);
+            }
+
+            local.m_sp_ring->m_thread_name = thread_name;
+            return *local.m_sp_ring;
+        }
+
+        static const char *kind_name(const int kind)
+        {
+            static const char *s_names[] = {"push", "queue", "handle", "fan_out"};
+            return (kind >= TRACE_PUSH && kind <= TRACE_FAN_OUT) ? s_names[kind] : "unknown";
+        }
+
+    public:
+        /// 开启跟踪，每sample_every次投递采样一次；ring_capacity只影响之后新建的环形缓冲
+        void enable(const int sample_every = 1, const int ring_capacity = TRACE_RING_CAPACITY)
+        {
+            m_sample_every.store(sample_every > 0 ? sample_every : 1);
+            m_ring_capacity.store(ring_capacity > 0 ? ring_capacity : TRACE_RING_CAPACITY);
+            m_enabled.store(true, std::memory_order_release);
+        }
+
+        void disable()
+        {
+            m_enabled.store(false, std::memory_order_release);
+        }
+
+        inline bool is_enabled() const
+        {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        /// 清空所有线程已记录的数据，应在没有线程写入时调用
+        void clear()
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            for (auto &sp_ring : m_rings)
+            {
+                sp_ring->clear();
+            }
+        }
+
+        /// 导出时用作进程名
+        void set_processor_name(const int processor_id, const std::string &name)
+        {
+            std::lock_guard<std::mutex> auto_lock(m_lock);
+            m_processor_names[processor_id] = name;
+        }
+
+        /// 标记当前线程为工作线程：只继承跟踪号，不发起新的采样，跟踪总是从外部投递开始
+        static inline void mark_worker_thread()
+        {
+            worker_thread() = true;
+        }
+
+        /// 投递时调用：继承当前线程的跟踪号，否则按采样率分配新号；不跟踪返回0，跟踪时p_push_ns写入投递时间
+        uint64_t on_push(const int processor_id, int64_t *p_push_ns)
+        {
+            uint64_t trace_id = current_trace();
+            if (trace_id == 0)
+            {
+                if (worker_thread())
+                {
+                    return 0;
+                }
+
+                static thread_local unsigned int s_push_count = 0;
+                if (++s_push_count < static_cast<unsigned int>(m_sample_every.load(std::memory_order_relaxed)))
+                {
+                    return 0;
+                }
+
+                s_push_count = 0;
+                trace_id = m_next_trace_id.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            int64_t now_ns = metrics_now_ns();
+            ring().record(trace_id, TRACE_PUSH, processor_id, now_ns, now_ns);
+            *p_push_ns = now_ns;
+            return trace_id;
+        }
+
+        /// 取出带跟踪号的任务时调用，只登记，由begin_batch()统一记录
+        static inline void on_take(const uint64_t trace_id, const int64_t push_ns)
+        {
+            std::vector<PendingTrace> &traces = pending();
+            if (traces.size() < TRACE_PENDING_LIMIT)
+            {
+                traces.push_back(PendingTrace{trace_id, push_ns});
+            }
+        }
+
+        /// 工作线程取到一批任务后调用：记录排队时间并把第一个跟踪号设为当前跟踪号；本批没有采样任务返回false
+        bool begin_batch(const int processor_id)
+        {
+            std::vector<PendingTrace> &traces = pending();
+            if (traces.empty())
+            {
+                return false;
+            }
+
+            const int64_t now_ns = metrics_now_ns();
+            TraceRing &cur_ring = ring();
+
+            for (auto &trace : traces)
+            {
+                cur_ring.record(trace.m_trace_id, TRACE_QUEUE, processor_id, trace.m_push_ns, now_ns);
+            }
+
+            current_trace() = traces.front().m_trace_id;
+            return true;
+        }
+
+        /// begin_batch()返回true后调用，记录处理与传递耗时并清除当前跟踪号
+        void end_batch(const int processor_id, const int64_t begin_ns, const int64_t handle_ns,
+                       const int64_t end_ns)
+        {
+            std::vector<PendingTrace> &traces = pending();
+            TraceRing &cur_ring = ring();
+
+            for (auto &trace : traces)
+            {
+                cur_ring.record(trace.m_trace_id, TRACE_HANDLE, processor_id, begin_ns, handle_ns);
+                cur_ring.record(trace.m_trace_id, TRACE_FAN_OUT, processor_id, handle_ns, end_ns);
+            }
+
+            traces.clear();
+            current_trace() = 0;
+        }
+
+        /// 丢弃当前线程登记的采样任务，不记录处理耗时
+        static inline void discard_batch()
+        {
+            pending().clear();
+            current_trace() = 0;
+        }
+
+        /// 收集所有线程保留的记录，按开始时间排序
+        void collect(std::vector<TraceRecord> &records)
+        {
+            records.clear();
+            {
+                std::lock_guard<std::mutex> auto_lock(m_lock);
+                for (auto &sp_ring : m_rings)
+                {
+                    sp_ring->collect(records);
+                }
+            }
+
+            std::stable_sort(records.begin(), records.end(), [](const TraceRecord &a, const TraceRecord &b) {
+                return a.m_begin_ns < b.m_begin_ns;
+            });
+        }
+
+        /// 导出Chrome trace event JSON：pid为单元id，tid为线程序号，同一跟踪号的记录用flow事件串联
+        void export_chrome_trace(std::string &json)
+        {
+            std::vector<TraceRecord> records;
+            collect(records);
+
+            std::map<int, std::string> processor_names;
+            std::vector<std::string> thread_names;
+            {
+                std::lock_guard<std::mutex> auto_lock(m_lock);
+                processor_names = m_processor_names;
+                for (auto &sp_ring : m_rings)
+                {
+                    thread_names.push_back(sp_ring->m_thread_name);
+                }
+            }
+
+            const int64_t base_ns = records.empty() ? 0 : records.front().m_begin_ns;
+            std::map<uint64_t, size_t> last_index; /// 每个跟踪号最后一条记录，用于标记flow终点
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                last_index[records[i].m_trace_id] = i;
+            }
+
+            std::ostringstream out;
+            out.setf(std::ios::fixed);
+            out.precision(3);
+            out << "{\"traceEvents\":[";
+
+            bool first = true;
+            auto separator = [&]() -> void {
+                if (!first)
+                {
+                    out << ",\n";
+                }
+
+                first = false;
+            };
+
+            std::map<int, bool> processors_seen;
+            std::map<std::pair<int, int>, bool> threads_seen;
+            std::map<uint64_t, bool> flow_started;
+
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                const TraceRecord &record = records[i];
+                const double ts_us = static_cast<double>(record.m_begin_ns - base_ns) / 1000.0;
+
+                processors_seen[record.m_processor_id] = true;
+                threads_seen[std::make_pair(record.m_processor_id, record.m_thread_index)] = true;
+
+                separator();
+                out << "{\"name\":\"" << kind_name(record.m_kind) << "\",\"cat\":\"processor\",\"pid\":"
+                    << record.m_processor_id << ",\"tid\":" << record.m_thread_index << ",\"ts\":" << ts_us;
+
+                if (record.m_kind == TRACE_PUSH)
+                {
+                    out << ",\"ph\":\"i\",\"s\":\"t\"";
+                }
+                else
+                {
+                    out << ",\"ph\":\"X\",\"dur\":"
+                        << static_cast<double>(record.m_end_ns - record.m_begin_ns) / 1000.0;
+                }
+
+                out << ",\"args\":{\"trace\":" << record.m_trace_id << "}}";
+
+                /// flow事件绑定到同一时间点的记录上
+                const char *p_phase = "t";
+                if (!flow_started[record.m_trace_id])
+                {
+                    flow_started[record.m_trace_id] = true;
+                    p_phase = "s";
+                }
+                else if (last_index[record.m_trace_id] == i)
+                {
+                    p_phase = "f";
+                }
+
+                separator();
+                out << "{\"name\":\"task\",\"cat\":\"flow\",\"ph\":\"" << p_phase << "\",\"bp\":\"e\",\"id\":"
+                    << record.m_trace_id << ",\"pid\":" << record.m_processor_id << ",\"tid\":"
+                    << record.m_thread_index << ",\"ts\":" << ts_us << "}";
+            }
+
+            for (auto &cur : processors_seen)
+            {
+                auto itr = processor_names.find(cur.first);
+                if (itr != processor_names.end())
+                {
+                    separator();
+                    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << cur.first
+                        << ",\"args\":{\"name\":\"" << metrics_json_escape(itr->second) << "\"}}";
+                }
+            }
+
+            for (auto &cur : threads_seen)
+            {
+                const size_t thread_index = static_cast<size_t>(cur.first.second);
+                if (thread_index < thread_names.size() && !thread_names[thread_index].empty())
+                {
+                    separator();
+                    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << cur.first.first << ",\"tid\":"
+                        << cur.first.second << ",\"args\":{\"name\":\"" << metrics_json_escape(thread_names[thread_index])
+                        << "\"}}";
+                }
+            }
+
+            out << "],\"displayTimeUnit\":\"ms\"}\n";
+            json = out.str();
+        }
+
+        /// 导出到文件，失败返回false
+        bool export_chrome_trace_file(const std::string &path)
+        {
+            std::string json;
+            export_chrome_trace(json);
+
+            std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+            if (!file.is_open())
+            {
+                return false;
+            }
+
+            file << json;
+            return file.good();
+        }
+    };
+
+}
+
+#endif
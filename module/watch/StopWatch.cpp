@@ -7,41 +7,121 @@
  */
 
 #include "StopWatch.h"
-StopWatch::StopWatch() : mStart(clock::now()) {
-   static_assert(std::chrono::steady_clock::is_steady, "Serious OS/C++ library issues. Steady clock is not steady");
-   // FYI:  This would fail  static_assert(std::chrono::high_resolution_clock::is_steady(), "High Resolution Clock is NOT steady on CentOS?!");
-}
+#include <mutex>
+#include <thread>
 
-StopWatch::StopWatch(const StopWatch& other): mStart(other.mStart) { 
-}
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
 
-/// @return StopWatch::StopWatch&  - assignment operator.
-StopWatch& StopWatch::operator=(const StopWatch& rhs) {
-      mStart = rhs.mStart;
-      return *this;
-}
+constexpr bool TscClock::is_steady;
+std::atomic<int> TscClock::sState(TscClock::kUncalibrated);
+uint64_t TscClock::sBaseTicks = 0;
+int64_t TscClock::sBaseNs = 0;
+uint64_t TscClock::sNsPerTickQ32 = 0;
 
-/// @return the elapsed microseconds since start
-uint64_t StopWatch::ElapsedUs() const {
-   return std::chrono::duration_cast<microseconds>(clock::now() - mStart).count();
-}
+namespace {
+   const int kCalibrationMs = 10;       // longer calibration gives a more precise frequency
+   const int kSampleTries = 5;
+   const double kMinTicksPerNs = 0.1;   // sanity bounds for the measured frequency: 100 MHz .. 10 GHz
+   const double kMaxTicksPerNs = 10.0;
+
+   int64_t SteadyNowNs() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+#if defined(__x86_64__)
+   /// @return true if the CPU has rdtscp and a TSC that ticks at a constant rate in all P/C-states
+   bool HasInvariantTsc() {
+      unsigned int eax, ebx, ecx, edx;
+      if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+         return false;
+      }
+
+      __get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
+      const bool rdtscp = (edx & (1u << 27)) != 0;
+
+      __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+      const bool invariant = (edx & (1u << 8)) != 0;
+      return rdtscp && invariant;
+   }
+
+   /**
+    * Reads the TSC and steady_clock as close together as possible: the steady_clock
+    * reading is bracketed by two TSC reads and the tightest bracket out of a few tries wins
+    */
+   void SamplePair(uint64_t& ticks, int64_t& ns) {
+      uint64_t bestWindow = UINT64_MAX;
+      for (int i = 0; i < kSampleTries; ++i) {
+         unsigned int aux;
+         const uint64_t before = __rdtscp(&aux);
+         const int64_t steady = SteadyNowNs();
+         const uint64_t after = __rdtscp(&aux);
 
-/// @return the elapsed milliseconds since start
-uint64_t StopWatch::ElapsedMs() const {
-   return std::chrono::duration_cast<milliseconds>(clock::now() - mStart).count();
+         if (after - before < bestWindow) {
+            bestWindow = after - before;
+            ticks = before + (after - before) / 2;
+            ns = steady;
+         }
+      }
+   }
+#endif
+} // namespace
+
+void TscClock::Calibrate() {
+#if defined(__x86_64__)
+   if (HasInvariantTsc()) {
+      uint64_t ticks0 = 0, ticks1 = 0;
+      int64_t ns0 = 0, ns1 = 0;
+
+      SamplePair(ticks0, ns0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(kCalibrationMs));
+      SamplePair(ticks1, ns1);
+
+      const double ticksPerNs = static_cast<double>(ticks1 - ticks0) / static_cast<double>(ns1 - ns0);
+      if (ns1 > ns0 && ticksPerNs >= kMinTicksPerNs && ticksPerNs <= kMaxTicksPerNs) {
+         sBaseTicks = ticks1;
+         sBaseNs = ns1;
+         sNsPerTickQ32 = static_cast<uint64_t>(4294967296.0 / ticksPerNs + 0.5);
+         sState.store(kTsc, std::memory_order_release);
+         return;
+      }
+   }
+#endif
+   sState.store(kFallback, std::memory_order_release);
 }
 
-/// @return the elapsed seconds since start
-uint64_t StopWatch::ElapsedSec() const {
-   return std::chrono::duration_cast<seconds>(clock::now() - mStart).count();
+/// @return steady_clock time, calibrating the TSC first if nobody has yet
+TscClock::time_point TscClock::NowSlow() noexcept {
+   static std::once_flag sOnce;
+   if (sState.load(std::memory_order_acquire) == kUncalibrated) {
+      std::call_once(sOnce, &TscClock::Calibrate);
+      if (sState.load(std::memory_order_acquire) == kTsc) {
+         return now();
+      }
+   }
+
+   return time_point(duration(SteadyNowNs()));
 }
-/**
- * Resets the start point
- * @return the updated start point
- */
-std::chrono::steady_clock::time_point StopWatch::Restart() {
-   mStart = clock::now();
-   return mStart;
+
+/// @return Ticks() after calibrating, steady_clock nanoseconds when the TSC is not used
+uint64_t TscClock::TicksSlow() noexcept {
+   NowSlow();
+#if defined(__x86_64__)
+   if (sState.load(std::memory_order_acquire) == kTsc) {
+      unsigned int aux;
+      return __rdtscp(&aux);
+   }
+#endif
+   return static_cast<uint64_t>(SteadyNowNs());
 }
 
+bool TscClock::IsTsc() {
+   now();
+   return sState.load(std::memory_order_acquire) == kTsc;
+}
 
+double TscClock::TicksPerNs() {
+   return IsTsc() ? 4294967296.0 / static_cast<double>(sNsPerTickQ32) : 0.0;
+}
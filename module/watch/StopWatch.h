@@ -9,26 +9,245 @@
 
 #pragma once
 #include <chrono>
+#include <atomic>
+#include <cstdint>
 
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
-class StopWatch {
+
+/**
+ * Steady clock read from the invariant TSC with rdtscp, converted to nanoseconds
+ * with a factor calibrated once against std::chrono::steady_clock on first use.
+ * It starts at the steady_clock reading taken during calibration, but the rate comes
+ * from a 10 ms calibration and drifts from steady_clock over time (ppm range), so only
+ * compare TscClock readings with each other; use steady_clock for absolute times.
+ * Readings taken before the calibration point (e.g. on a CPU whose TSC lags slightly)
+ * are clamped to it instead of wrapping.
+ * Falls back to steady_clock when the CPU has no invariant TSC or rdtscp,
+ * e.g. on other architectures or in VMs hiding the feature bits.
+ */
+class TscClock {
+public:
+   typedef int64_t rep;
+   typedef std::nano period;
+   typedef std::chrono::duration<rep, period> duration;
+   typedef std::chrono::time_point<TscClock, duration> time_point;
+   static constexpr bool is_steady = true;
+
+   static inline time_point now() noexcept {
+#if defined(__x86_64__)
+      if (sState.load(std::memory_order_acquire) == kTsc) {
+         unsigned int aux;
+         const int64_t ticks = static_cast<int64_t>(__rdtscp(&aux) - sBaseTicks);
+         const uint64_t since = ticks > 0 ? static_cast<uint64_t>(ticks) : 0;
+         return time_point(duration(sBaseNs + static_cast<int64_t>(
+                 (static_cast<unsigned __int128>(since) * sNsPerTickQ32) >> 32)));
+      }
+#endif
+      return NowSlow();
+   }
+
+   /**
+    * Raw reading for interval measurements: TSC ticks, or steady_clock nanoseconds in the
+    * fallback. Only the difference of two readings means anything; convert it with TicksToNs().
+    * rdtscp waits for earlier instructions, so the measured work is done before the read
+    */
+   static inline uint64_t Ticks() noexcept {
+#if defined(__x86_64__)
+      if (sState.load(std::memory_order_acquire) == kTsc) {
+         unsigned int aux;
+         return __rdtscp(&aux);
+      }
+#endif
+      return TicksSlow();
+   }
+
+   /// @return nanoseconds between two Ticks() readings, 0 if the end reading is earlier
+   static inline int64_t TicksToNs(uint64_t start, uint64_t end) noexcept {
+      const int64_t ticks = static_cast<int64_t>(end - start);
+      if (ticks <= 0) {
+         return 0;
+      }
+#if defined(__x86_64__)
+      if (sState.load(std::memory_order_acquire) == kTsc) {
+         return static_cast<int64_t>((static_cast<unsigned __int128>(ticks) * sNsPerTickQ32) >> 32);
+      }
+#endif
+      return ticks;
+   }
+
+   /// @return true when now() reads the TSC, false when it uses steady_clock
+   static bool IsTsc();
+
+   /// @return the calibrated TSC frequency in ticks per nanosecond, 0 when TSC is not used
+   static double TicksPerNs();
+
+private:
+   enum State { kUncalibrated = 0, kTsc = 1, kFallback = 2 };
+
+   static time_point NowSlow() noexcept;
+   static uint64_t TicksSlow() noexcept;
+   static void Calibrate();
+
+   static std::atomic<int> sState;
+   static uint64_t sBaseTicks;
+   static int64_t sBaseNs;
+   static uint64_t sNsPerTickQ32; // nanoseconds per tick in 32.32 fixed point
+};
+
+
+template<typename Clock>
+class BasicStopWatch {
 public:
-   typedef std::chrono::steady_clock clock;
+   typedef Clock clock;
+   typedef std::chrono::nanoseconds nanoseconds;
    typedef std::chrono::microseconds microseconds;
    typedef std::chrono::milliseconds milliseconds;
    typedef std::chrono::seconds seconds;
 
-   StopWatch();
-   StopWatch(const StopWatch&);
-   StopWatch& operator=(const StopWatch& rhs);
+   BasicStopWatch() : mStart(clock::now()) {
+      static_assert(clock::is_steady, "Serious OS/C++ library issues. Steady clock is not steady");
+      // FYI:  This would fail  static_assert(std::chrono::high_resolution_clock::is_steady(), "High Resolution Clock is NOT steady on CentOS?!");
+   }
+
+   BasicStopWatch(const BasicStopWatch& other) : mStart(other.mStart) {
+   }
+
+   /// @return BasicStopWatch&  - assignment operator.
+   BasicStopWatch& operator=(const BasicStopWatch& rhs) {
+      mStart = rhs.mStart;
+      return *this;
+   }
+
+   /// @return the elapsed time since start in the clock's own resolution
+   typename clock::duration Elapsed() const {
+      return clock::now() - mStart;
+   }
+
+   /// @return the elapsed nanoseconds since start
+   uint64_t ElapsedNs() const {
+      return std::chrono::duration_cast<nanoseconds>(clock::now() - mStart).count();
+   }
+
+   /// @return the elapsed microseconds since start
+   uint64_t ElapsedUs() const {
+      return std::chrono::duration_cast<microseconds>(clock::now() - mStart).count();
+   }
 
-   uint64_t ElapsedUs() const;
-   uint64_t ElapsedMs() const;
-   uint64_t ElapsedSec() const;
+   /// @return the elapsed milliseconds since start
+   uint64_t ElapsedMs() const {
+      return std::chrono::duration_cast<milliseconds>(clock::now() - mStart).count();
+   }
 
-   std::chrono::steady_clock::time_point Restart();
+   /// @return the elapsed seconds since start
+   uint64_t ElapsedSec() const {
+      return std::chrono::duration_cast<seconds>(clock::now() - mStart).count();
+   }
+
+   /**
+    * Records the elapsed nanoseconds into anything with a record(uint64_t) member,
+    * e.g. a LatencyHistogram; restart=true starts the next interval at the same reading
+    * @return the recorded nanoseconds
+    */
+   template<typename Histogram>
+   uint64_t RecordNs(Histogram& histogram, bool restart = false) {
+      const typename clock::time_point now = clock::now();
+      const uint64_t ns = std::chrono::duration_cast<nanoseconds>(now - mStart).count();
+      histogram.record(ns);
+      if (restart) {
+         mStart = now;
+      }
+      return ns;
+   }
+
+   /**
+    * Resets the start point
+    * @return the updated start point
+    */
+   typename clock::time_point Restart() {
+      mStart = clock::now();
+      return mStart;
+   }
 
 private:
-   clock::time_point mStart;
+   typename clock::time_point mStart;
 };
 
+/**
+ * TscClock stop watch keeping the raw Ticks() reading: starting and restarting only read the
+ * counter, the tick-to-nanosecond conversion happens when an elapsed time is asked for.
+ * Inside a VM rdtscp may be intercepted and cost about as much as a clock_gettime call
+ */
+template<>
+class BasicStopWatch<TscClock> {
+public:
+   typedef TscClock clock;
+
+   BasicStopWatch() : mStart(clock::Ticks()) {
+   }
+
+   BasicStopWatch(const BasicStopWatch& other) : mStart(other.mStart) {
+   }
+
+   /// @return BasicStopWatch&  - assignment operator.
+   BasicStopWatch& operator=(const BasicStopWatch& rhs) {
+      mStart = rhs.mStart;
+      return *this;
+   }
+
+   /// @return the elapsed time since start
+   clock::duration Elapsed() const {
+      return clock::duration(clock::TicksToNs(mStart, clock::Ticks()));
+   }
+
+   /// @return the elapsed nanoseconds since start
+   uint64_t ElapsedNs() const {
+      return static_cast<uint64_t>(clock::TicksToNs(mStart, clock::Ticks()));
+   }
+
+   /// @return the elapsed microseconds since start
+   uint64_t ElapsedUs() const {
+      return ElapsedNs() / 1000;
+   }
+
+   /// @return the elapsed milliseconds since start
+   uint64_t ElapsedMs() const {
+      return ElapsedNs() / 1000000;
+   }
+
+   /// @return the elapsed seconds since start
+   uint64_t ElapsedSec() const {
+      return ElapsedNs() / 1000000000;
+   }
+
+   /// Same as BasicStopWatch::RecordNs, one counter read per call
+   template<typename Histogram>
+   uint64_t RecordNs(Histogram& histogram, bool restart = false) {
+      const uint64_t now = clock::Ticks();
+      const uint64_t ns = static_cast<uint64_t>(clock::TicksToNs(mStart, now));
+      histogram.record(ns);
+      if (restart) {
+         mStart = now;
+      }
+      return ns;
+   }
+
+   /**
+    * Resets the start point
+    * @return the raw start reading, see TscClock::Ticks()
+    */
+   uint64_t Restart() {
+      mStart = clock::Ticks();
+      return mStart;
+   }
+
+private:
+   uint64_t mStart;
+};
+
+typedef BasicStopWatch<std::chrono::steady_clock> StopWatch;
+
+/// StopWatch reading the TSC, see BasicStopWatch<TscClock>
+typedef BasicStopWatch<TscClock> TscStopWatch;